@@ -0,0 +1,771 @@
+// Micro-benchmark of the TcpCDG per-ACK hot path.
+//
+// Drives TcpCDG instances with synthetic TcpSocketState objects and RTT
+// streams, the way TcpSocketBase calls them on every ACK, and times the
+// per-ACK kernels on their own. For every scenario it reports the best
+// ns/ACK over the repetitions, heap allocations per ACK and, where the
+// kernel allows perf_event_open, user-space instructions per ACK.
+//
+//   tcp-cdg-bench --writeBaseline=cdg-bench.baseline
+//   tcp-cdg-bench --baseline=cdg-bench.baseline --tolerance=0.1
+//
+// --nexpCheck instead verifies every NexpBatch kernel bit for bit against
+// nexp_u32 over its whole input range, reports its accuracy against
+// std::exp and the throughput of each kernel and of std::exp.
+//
+// --shadowCheck instead verifies that a loss one to four RTTs after a
+// delay-based backoff still reduces cwnd, i.e. that the shadow window does
+// not outgrow cwnd and cancel the reduction. Its exit status is 1 if not.
+//
+// --backoffCheck instead verifies that a delay-based backoff cuts cwnd to
+// the new ssthresh and leaves the socket's own state alone, exiting with
+// status 1 if not.
+//
+// --filterCompare instead runs the same RTT streams through the window and
+// the EWMA gradient filter and reports, for each, ns/ACK, the spread of the
+// smoothed gradients and the backoffs taken. The grad and grad_ewma (and
+// avoidance and avoidance_ewma) scenarios time the two filters as well.
+//
+// With --baseline the exit status is 1 if any scenario got slower or uses
+// more instructions than the baseline allows, or allocates more per ACK.
+// Baselines are machine specific and are not kept in the tree.
+#include <iostream>
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/tcp-cdg.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <sstream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+// Every heap allocation in the process goes through here, so the number of
+// allocations made by the measured loop can be read off directly.
+static std::atomic<uint64_t> g_allocations (0);
+
+void *operator new (std::size_t size)
+{
+  g_allocations.fetch_add (1, std::memory_order_relaxed);
+  void *p = std::malloc (size ? size : 1);
+  if (!p)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void *operator new[] (std::size_t size)
+{
+  return operator new (size);
+}
+
+void operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+void operator delete[] (void *p) noexcept
+{
+  std::free (p);
+}
+
+// User-space retired instructions of this thread, if the kernel lets us.
+class InstructionCounter
+{
+public:
+  InstructionCounter ()
+  {
+    struct perf_event_attr attr;
+    std::memset (&attr, 0, sizeof (attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof (attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  ~InstructionCounter ()
+  {
+    if (m_fd >= 0)
+      {
+        close (m_fd);
+      }
+  }
+
+  bool IsAvailable (void) const
+  {
+    return m_fd >= 0;
+  }
+
+  void Start (void)
+  {
+    if (m_fd >= 0)
+      {
+        ioctl (m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl (m_fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+  }
+
+  uint64_t Stop (void)
+  {
+    uint64_t count = 0;
+    if (m_fd >= 0)
+      {
+        ioctl (m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read (m_fd, &count, sizeof (count)) != sizeof (count))
+          {
+            count = 0;
+          }
+      }
+    return count;
+  }
+
+private:
+  long m_fd;
+};
+
+static const uint32_t SEGMENT = 1448;
+
+// One flow's sender state, advanced by one segment per ACK.
+struct Flow
+{
+  Ptr<TcpSocketState> tcb;
+  Ptr<TcpCDG> cdg;
+};
+
+Flow makeFlow (uint32_t cwndSegments, uint32_t ssThreshSegments, uint32_t backoffFactor, uint32_t ineffectiveThresh)
+{
+  Flow flow;
+  flow.tcb = CreateObject<TcpSocketState> ();
+  flow.tcb->m_segmentSize = SEGMENT;
+  flow.tcb->m_cWnd = cwndSegments * SEGMENT;
+  flow.tcb->m_ssThresh = ssThreshSegments * SEGMENT;
+  flow.tcb->m_lastAckedSeq = SequenceNumber32 (1);
+  flow.tcb->m_nextTxSequence = flow.tcb->m_lastAckedSeq + flow.tcb->m_cWnd.Get ();
+  flow.tcb->m_highTxMark = flow.tcb->m_nextTxSequence;
+  flow.tcb->m_congState = TcpSocketState::CA_OPEN;
+  flow.cdg = CreateObject<TcpCDG> ();
+  flow.cdg->SetAttribute ("BackoffBeta", UintegerValue (717));
+  flow.cdg->SetAttribute ("BackoffFactor", UintegerValue (backoffFactor));
+  flow.cdg->SetAttribute ("IneffectiveThresh", UintegerValue (ineffectiveThresh));
+  flow.cdg->SetAttribute ("IneffectiveHold", UintegerValue (5));
+  flow.cdg->AssignStreams (1);
+  return flow;
+}
+
+// The calls TcpSocketBase makes for a new ACK of one segment in the open
+// state, with the flow kept cwnd-limited. A backoff cuts cwnd itself, so
+// the flow never leaves CA_OPEN.
+inline void ack (Flow &flow, const Time &rtt)
+{
+  TcpSocketState *tcb = PeekPointer (flow.tcb);
+  tcb->m_lastAckedSeq += SEGMENT;
+  tcb->m_nextTxSequence = tcb->m_lastAckedSeq + tcb->m_cWnd.Get ();
+  tcb->m_highTxMark = tcb->m_nextTxSequence;
+  flow.cdg->PktsAcked (flow.tcb, 1, rtt);
+  flow.cdg->IncreaseWindow (flow.tcb, 1);
+}
+
+// A loss or CE mark: the window is set to the congestion control's
+// ssthresh, as TcpSocketBase does on entering recovery or CWR.
+inline void reduce (Flow &flow)
+{
+  TcpSocketState *tcb = PeekPointer (flow.tcb);
+  uint32_t ssThresh = flow.cdg->GetSsThresh (flow.tcb, tcb->m_cWnd.Get ());
+  tcb->m_ssThresh = ssThresh;
+  tcb->m_cWnd = std::max (ssThresh, 2 * SEGMENT);
+}
+
+struct Result
+{
+  double nsPerAck;
+  double allocsPerAck;
+  double instrPerAck;
+};
+
+// A scenario sets up its flow outside the measured region and returns a
+// loop over 'acks' ACKs to be timed.
+struct Scenario
+{
+  std::string name;
+  std::string description;
+  void (*run) (Flow &flow, const std::vector<Time> &rtts, uint32_t acks);
+  Flow (*setup) (void);
+  std::vector<Time> (*rtts) (uint32_t count);
+};
+
+// RTT streams: a slow rise, a sawtooth around a standing queue, and a steep
+// rise that makes nearly every gradient a backoff candidate.
+std::vector<Time> risingRtts (uint32_t count)
+{
+  std::vector<Time> rtts;
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      rtts.push_back (NanoSeconds (100000 + (i % 4096) * 50));
+    }
+  return rtts;
+}
+
+std::vector<Time> sawtoothRtts (uint32_t count)
+{
+  std::vector<Time> rtts;
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      uint32_t phase = i % 400;
+      rtts.push_back (NanoSeconds (100000 + (phase < 200 ? phase : 400 - phase) * 500 + (i * 7919) % 3000));
+    }
+  return rtts;
+}
+
+std::vector<Time> steepRtts (uint32_t count)
+{
+  std::vector<Time> rtts;
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      rtts.push_back (NanoSeconds (100000 + (i % 500) * 1000));
+    }
+  return rtts;
+}
+
+// HyStart is off: risingRtts crosses its delay threshold within a few
+// hundred ACKs, which would end slow start and leave the scenario timing
+// congestion avoidance. (The ACK-train detector reads Simulator::Now (),
+// which never advances here.)
+Flow slowStartFlow (void)
+{
+  Flow flow = makeFlow (10, 0xffffffff / SEGMENT, 333, 5);
+  flow.cdg->SetAttribute ("HystartDetect", UintegerValue (0));
+  return flow;
+}
+
+Flow avoidanceFlow (void)
+{
+  return makeFlow (100, 50, 333, 5);
+}
+
+Flow backoffFlow (void)
+{
+  return makeFlow (100, 50, 50000, 0);
+}
+
+Flow ewmaFlow (void)
+{
+  Flow flow = avoidanceFlow ();
+  flow.cdg->SetAttribute ("GradientFilter", StringValue ("ewma"));
+  return flow;
+}
+
+void runSlowStart (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      ack (flow, rtts[i % rtts.size ()]);
+      // A backoff lowers ssthresh as well; restart slow start from scratch
+      if (flow.tcb->m_cWnd.Get () > 10000 * SEGMENT
+          || flow.tcb->m_cWnd.Get () >= flow.tcb->m_ssThresh.Get ())
+        {
+          flow.tcb->m_cWnd = 10 * SEGMENT;
+          flow.tcb->m_ssThresh = 0xffffffff / SEGMENT * SEGMENT;
+        }
+    }
+}
+
+void runAvoidance (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      ack (flow, rtts[i % rtts.size ()]);
+      if (i % 5000 == 4999)
+        {
+          reduce (flow);
+        }
+    }
+}
+
+void runEcn (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      bool ce = i % 10 == 0;
+      flow.cdg->CwndEvent (flow.tcb, ce ? TcpSocketState::CA_EVENT_ECN_IS_CE : TcpSocketState::CA_EVENT_ECN_NO_CE);
+      ack (flow, rtts[i % rtts.size ()]);
+      if (ce && i % 1000 == 0)
+        {
+          reduce (flow);
+        }
+    }
+}
+
+// The kernels on their own, one call (or sample and gradient) per "ACK".
+void runNexp (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  uint32_t sink = 0;
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      sink += flow.cdg->nexp_u32 ((i * 2654435761U) >> 7);
+    }
+  volatile uint32_t keep = sink;
+  (void) keep;
+}
+
+void runGrad (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  int32_t sink = 0;
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      flow.cdg->PktsAcked (flow.tcb, 1, rtts[i % rtts.size ()]);
+      sink += flow.cdg->tcp_cdg_grad (flow.tcb);
+    }
+  volatile int32_t keep = sink;
+  (void) keep;
+}
+
+void runBackoff (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  int sink = 0;
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      sink += flow.cdg->tcp_cdg_backoff (flow.tcb, 1 + i % 64);
+      flow.tcb->m_cWnd = 100 * SEGMENT;
+    }
+  volatile int keep = sink;
+  (void) keep;
+}
+
+// NexpBatch over a block of 64 exponents per "ACK", so the figure is per
+// 64 evaluations.
+void runNexpBatch (Flow &flow, const std::vector<Time> &rtts, uint32_t acks)
+{
+  static std::vector<uint32_t> in, out (64);
+  if (in.empty ())
+    {
+      for (uint32_t i = 0; i < 64; ++i)
+        {
+          in.push_back ((i * 2654435761U) >> 7);
+        }
+    }
+  for (uint32_t i = 0; i < acks; ++i)
+    {
+      TcpCDG::NexpBatch (&in[0], &out[0], in.size ());
+    }
+}
+
+// nexp_u32(ux) approximates 2^32 exp(-ux / 1e6). Check each kernel against
+// the scalar table on all inputs below the 2^24 cut-off and a spread above,
+// then report the error of the table against std::exp and throughputs.
+int nexpCheck (void)
+{
+  static const char *names[] = { "auto", "scalar", "sse2", "avx2" };
+  const uint32_t cutoff = 1U << 24;
+  std::vector<uint32_t> in;
+  for (uint32_t ux = 0; ux < cutoff; ++ux)
+    {
+      in.push_back (ux);
+    }
+  for (uint32_t k = 0; k < 4099; ++k)
+    {
+      in.push_back (cutoff + k * 1048573U);
+    }
+  in.push_back (0xffffffff);
+  std::vector<uint32_t> expect (in.size ()), out (in.size ());
+  for (uint32_t i = 0; i < in.size (); ++i)
+    {
+      expect[i] = TcpCDG::nexp_u32 (in[i]);
+    }
+
+  uint32_t failed = 0;
+  std::cout << std::left << std::setw (10) << "kernel" << std::right << std::setw (12) << "mismatches"
+            << std::setw (12) << "ns/value" << std::endl;
+  for (uint32_t k = TcpCDG::NEXP_AUTO; k <= TcpCDG::NEXP_AVX2; ++k)
+    {
+      TcpCDG::NexpKernel kernel = TcpCDG::NexpKernel (k);
+      if (!TcpCDG::NexpKernelSupported (kernel))
+        {
+          std::cout << std::left << std::setw (10) << names[k] << std::right << std::setw (12) << "unsupported" << std::endl;
+          continue;
+        }
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      TcpCDG::NexpBatch (&in[0], &out[0], in.size (), kernel);
+      double ns = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now () - start).count ();
+      uint64_t mismatches = 0;
+      for (uint32_t i = 0; i < in.size (); ++i)
+        {
+          mismatches += out[i] != expect[i];
+        }
+      failed += mismatches != 0;
+      std::cout << std::left << std::setw (10) << names[k] << std::right << std::setw (12) << mismatches
+                << std::fixed << std::setprecision (2) << std::setw (12) << ns / in.size () << std::endl;
+    }
+
+  double maxAbs = 0, maxRel = 0, sink = 0;
+  uint32_t maxAbsAt = 0, maxRelAt = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  for (uint32_t ux = 0; ux < cutoff; ++ux)
+    {
+      sink += std::exp (-double (ux) / 1e6);
+    }
+  double expNs = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now () - start).count () / cutoff;
+  volatile double keep = sink;
+  (void) keep;
+  for (uint32_t ux = 0; ux < cutoff; ++ux)
+    {
+      double exact = std::exp (-double (ux) / 1e6);
+      double approx = expect[ux] / 4294967296.0;
+      double abs = std::fabs (approx - exact);
+      if (abs > maxAbs)
+        {
+          maxAbs = abs;
+          maxAbsAt = ux;
+        }
+      // Relative error only where the probability is still representable
+      if (exact > 1e-6 && abs / exact > maxRel)
+        {
+          maxRel = abs / exact;
+          maxRelAt = ux;
+        }
+    }
+  std::cout << std::left << std::setw (10) << "std::exp" << std::right << std::setw (12) << "-"
+            << std::setw (12) << expNs << std::endl;
+  std::cout << std::scientific << std::setprecision (3)
+            << "max absolute error " << maxAbs << " at ux=" << maxAbsAt
+            << ", max relative error " << maxRel << " at ux=" << maxRelAt
+            << " (exp(-x) > 1e-6)" << std::endl;
+  if (failed)
+    {
+      std::cout << failed << " kernel(s) differ from nexp_u32" << std::endl;
+    }
+  return failed ? 1 : 0;
+}
+
+// Back a flow off, let it grow for 'rounds' windows at a steady RTT, then
+// lose a packet: the window must come down.
+int shadowCheck (void)
+{
+  const Time rtt = MicroSeconds (100);
+  uint32_t failed = 0;
+  std::cout << std::left << std::setw (8) << "rtts" << std::right << std::setw (12) << "backoff"
+            << std::setw (12) << "before" << std::setw (12) << "after" << std::endl;
+  for (uint32_t rounds = 1; rounds <= 4; ++rounds)
+    {
+      Flow flow = backoffFlow ();
+      // A steady RTT gives zero gradients, so no backoff is drawn here
+      for (uint32_t i = 0; i < 4 * 100; ++i)
+        {
+          ack (flow, rtt);
+        }
+      uint32_t tries = 0;
+      while (!flow.cdg->tcp_cdg_backoff (flow.tcb, 1000) && ++tries < 1000)
+        {
+        }
+      uint32_t backoff = flow.tcb->m_cWnd.Get ();
+      for (uint32_t r = 0; r < rounds; ++r)
+        {
+          uint32_t window = flow.tcb->m_cWnd.Get () / SEGMENT;
+          for (uint32_t i = 0; i < window; ++i)
+            {
+              ack (flow, rtt);
+            }
+        }
+      uint32_t before = flow.tcb->m_cWnd.Get ();
+      reduce (flow);
+      uint32_t after = flow.tcb->m_cWnd.Get ();
+      bool ok = tries < 1000 && after < before;
+      failed += !ok;
+      std::cout << std::left << std::setw (8) << rounds << std::right << std::setw (12) << backoff / SEGMENT
+                << std::setw (12) << before / SEGMENT << std::setw (12) << after / SEGMENT
+                << (ok ? "" : "  FAILED") << std::endl;
+    }
+  return failed ? 1 : 0;
+}
+
+// Take one backoff at each of a range of windows: cwnd must drop to the
+// new ssthresh (BackoffBeta of it) at once, and the backoff must leave the
+// socket's own state alone: still CA_OPEN, with highTxMark, initial cwnd
+// and initial ssthresh untouched.
+int backoffCheck (void)
+{
+  uint32_t failed = 0;
+  std::cout << std::left << std::setw (8) << "cwnd" << std::right << std::setw (12) << "after"
+            << std::setw (12) << "ssthresh" << std::endl;
+  for (uint32_t segments = 4; segments <= 4096; segments *= 4)
+    {
+      Flow flow = makeFlow (segments, segments / 2, 50000, 0);
+      flow.tcb->m_initialCWnd = 10;
+      flow.tcb->m_initialSsThresh = 0xffffffff;
+      SequenceNumber32 highTxMark = flow.tcb->m_highTxMark.Get ();
+      uint32_t before = flow.tcb->m_cWnd.Get ();
+      uint32_t tries = 0;
+      while (!flow.cdg->tcp_cdg_backoff (flow.tcb, 1000) && ++tries < 1000)
+        {
+        }
+      uint32_t after = flow.tcb->m_cWnd.Get ();
+      uint32_t expect = std::max (2 * SEGMENT, uint32_t ((uint64_t (before) * 717) >> 10));
+      bool ok = tries < 1000 && after < before && after == expect
+        && flow.tcb->m_ssThresh.Get () == expect
+        && flow.tcb->m_congState == TcpSocketState::CA_OPEN
+        && flow.tcb->m_highTxMark.Get () == highTxMark
+        && flow.tcb->m_initialCWnd == 10 && flow.tcb->m_initialSsThresh == 0xffffffff;
+      failed += !ok;
+      std::cout << std::left << std::setw (8) << segments << std::right << std::setw (12) << after / double (SEGMENT)
+                << std::setw (12) << flow.tcb->m_ssThresh.Get () / double (SEGMENT)
+                << (ok ? "" : "  FAILED") << std::endl;
+    }
+  return failed ? 1 : 0;
+}
+
+// What one filter made of an RTT stream: the smoothed gmin of every
+// measurement and the backoffs drawn from them.
+struct FilterStats
+{
+  uint64_t gradients;
+  double sum;
+  double sumSquares;
+  uint64_t backoffs;
+};
+
+void countGradient (FilterStats *stats, int32_t gmin, int32_t gmax)
+{
+  ++stats->gradients;
+  stats->sum += gmin;
+  stats->sumSquares += double (gmin) * gmin;
+}
+
+void countBackoff (FilterStats *stats, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+  ++stats->backoffs;
+}
+
+// Feed each RTT stream to an avoidance flow with either filter, as the
+// avoidance scenario does, and report what each one smooths to. The window
+// filter is skipped when built with TCP_CDG_MAX_WINDOW=0.
+int filterCompare (uint32_t acks)
+{
+  typedef std::vector<Time> (*Stream) (uint32_t);
+  const char *streamNames[] = { "rising", "sawtooth", "steep" };
+  const Stream streams[] = { &risingRtts, &sawtoothRtts, &steepRtts };
+  const char *filters[] = { "window", "ewma" };
+  std::cout << std::left << std::setw (10) << "rtts" << std::setw (8) << "filter" << std::right
+            << std::setw (10) << "ns/ack" << std::setw (12) << "gradients" << std::setw (12) << "mean"
+            << std::setw (12) << "stddev" << std::setw (10) << "backoffs" << std::endl;
+  for (uint32_t s = 0; s < sizeof (streams) / sizeof (streams[0]); ++s)
+    {
+      std::vector<Time> rtts = streams[s] (8192);
+      for (uint32_t f = TcpCDG::MAX_WINDOW ? 0 : 1; f < 2; ++f)
+        {
+          Flow flow = avoidanceFlow ();
+          flow.cdg->SetAttribute ("GradientFilter", StringValue (filters[f]));
+          FilterStats stats = { 0, 0, 0, 0 };
+          flow.cdg->TraceConnectWithoutContext ("SmoothedGradient", MakeBoundCallback (&countGradient, &stats));
+          flow.cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&countBackoff, &stats));
+          std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+          runAvoidance (flow, rtts, acks);
+          std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now ();
+          double mean = stats.gradients ? stats.sum / stats.gradients : 0;
+          double variance = stats.gradients ? stats.sumSquares / stats.gradients - mean * mean : 0;
+          std::cout << std::left << std::setw (10) << streamNames[s] << std::setw (8) << filters[f] << std::right
+                    << std::fixed << std::setprecision (2)
+                    << std::setw (10) << std::chrono::duration<double, std::nano> (end - start).count () / acks
+                    << std::setw (12) << stats.gradients << std::setprecision (1) << std::setw (12) << mean
+                    << std::setw (12) << std::sqrt (std::max (variance, 0.0)) << std::setw (10) << stats.backoffs
+                    << std::endl;
+        }
+    }
+  return 0;
+}
+
+Result measure (const Scenario &scenario, uint32_t acks, uint32_t repeat, InstructionCounter &instructions)
+{
+  std::vector<Time> rtts = scenario.rtts (8192);
+  Result best = { std::numeric_limits<double>::max (), std::numeric_limits<double>::max (),
+                  std::numeric_limits<double>::max () };
+  for (uint32_t r = 0; r < repeat; ++r)
+    {
+      Flow flow = scenario.setup ();
+      // One untimed pass warms caches and takes the flow past its start-up
+      scenario.run (flow, rtts, std::min (acks, 10000U));
+
+      uint64_t allocations = g_allocations.load ();
+      instructions.Start ();
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      scenario.run (flow, rtts, acks);
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now ();
+      uint64_t instr = instructions.Stop ();
+      allocations = g_allocations.load () - allocations;
+
+      best.nsPerAck = std::min (best.nsPerAck, std::chrono::duration<double, std::nano> (end - start).count () / acks);
+      best.allocsPerAck = std::min (best.allocsPerAck, double (allocations) / acks);
+      best.instrPerAck = instructions.IsAvailable () ? std::min (best.instrPerAck, double (instr) / acks) : -1;
+    }
+  return best;
+}
+
+// Baseline files hold one "scenario nsPerAck allocsPerAck instrPerAck" line
+// per scenario; '#' starts a comment line and -1 means not measured.
+std::map<std::string, Result> readBaseline (const std::string &fileName)
+{
+  std::ifstream in (fileName.c_str ());
+  if (!in)
+    {
+      NS_FATAL_ERROR ("Cannot open baseline " << fileName);
+    }
+  std::map<std::string, Result> baseline;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.empty () || line[0] == '#')
+        {
+          continue;
+        }
+      std::istringstream is (line);
+      std::string name;
+      Result r;
+      if (!(is >> name >> r.nsPerAck >> r.allocsPerAck >> r.instrPerAck))
+        {
+          NS_FATAL_ERROR ("Malformed baseline line '" << line << "'");
+        }
+      baseline[name] = r;
+    }
+  return baseline;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t acks = 1000000;
+  uint32_t repeat = 5;
+  std::string only = "";
+  std::string baselineFile = "";
+  std::string writeBaseline = "";
+  double tolerance = 0.10;
+  bool nexp = false;
+  bool shadow = false;
+  bool backoff = false;
+  bool filters = false;
+
+  CommandLine cmd;
+  cmd.AddValue ("acks", "ACKs per measured run", acks);
+  cmd.AddValue ("repeat", "Runs per scenario; the best one is reported", repeat);
+  cmd.AddValue ("scenario", "Run only this scenario", only);
+  cmd.AddValue ("baseline", "Compare against this baseline and fail on regressions", baselineFile);
+  cmd.AddValue ("writeBaseline", "Write the results as a new baseline", writeBaseline);
+  cmd.AddValue ("tolerance", "Allowed relative increase of ns/ACK and instructions/ACK", tolerance);
+  cmd.AddValue ("nexpCheck", "Check the NexpBatch kernels against nexp_u32 and std::exp instead", nexp);
+  cmd.AddValue ("shadowCheck", "Check that losses after a backoff still reduce cwnd instead", shadow);
+  cmd.AddValue ("backoffCheck", "Check that a backoff cuts cwnd to the new ssthresh instead", backoff);
+  cmd.AddValue ("filterCompare", "Compare the window and EWMA gradient filters on the same RTT streams instead", filters);
+  cmd.Parse (argc, argv);
+
+  if (nexp)
+    {
+      return nexpCheck ();
+    }
+  if (shadow)
+    {
+      return shadowCheck ();
+    }
+  if (backoff)
+    {
+      return backoffCheck ();
+    }
+  if (filters)
+    {
+      return filterCompare (acks);
+    }
+
+  const Scenario scenarios[] = {
+    { "slowstart", "PktsAcked + IncreaseWindow, slow start, slowly rising RTT", &runSlowStart, &slowStartFlow, &risingRtts },
+    { "avoidance", "PktsAcked + IncreaseWindow, congestion avoidance, periodic losses", &runAvoidance, &avoidanceFlow, &sawtoothRtts },
+    { "avoidance_ewma", "As avoidance, EWMA gradient filter", &runAvoidance, &ewmaFlow, &sawtoothRtts },
+    { "heavybackoff", "PktsAcked + IncreaseWindow, steep RTT rise, backoff almost always taken", &runAvoidance, &backoffFlow, &steepRtts },
+    { "ecn", "CE marks on every 10th ACK, ECN reductions", &runEcn, &avoidanceFlow, &sawtoothRtts },
+    { "nexp_u32", "nexp_u32 over the whole input range", &runNexp, &avoidanceFlow, &risingRtts },
+    { "grad", "PktsAcked + tcp_cdg_grad per sample, default filter", &runGrad, &avoidanceFlow, &sawtoothRtts },
+    { "grad_ewma", "As grad, EWMA gradient filter", &runGrad, &ewmaFlow, &sawtoothRtts },
+    { "backoff", "tcp_cdg_backoff with positive gradients", &runBackoff, &backoffFlow, &steepRtts },
+    { "nexp_batch", "NexpBatch over 64 exponents, fastest kernel", &runNexpBatch, &avoidanceFlow, &risingRtts },
+  };
+
+  std::map<std::string, Result> baseline;
+  if (!baselineFile.empty ())
+    {
+      baseline = readBaseline (baselineFile);
+    }
+  std::ofstream out;
+  if (!writeBaseline.empty ())
+    {
+      out.open (writeBaseline.c_str ());
+      if (!out)
+        {
+          NS_FATAL_ERROR ("Cannot write baseline " << writeBaseline);
+        }
+      out << "# tcp-cdg-bench baseline: scenario nsPerAck allocsPerAck instrPerAck" << std::endl;
+    }
+
+  InstructionCounter instructions;
+  if (!instructions.IsAvailable ())
+    {
+      std::cout << "perf_event_open unavailable, instructions are not counted" << std::endl;
+    }
+  std::cout << std::left << std::setw (14) << "scenario" << std::right
+            << std::setw (12) << "ns/ack" << std::setw (14) << "allocs/ack" << std::setw (14) << "instr/ack"
+            << "  baseline" << std::endl;
+
+  uint32_t regressions = 0;
+  for (uint32_t i = 0; i < sizeof (scenarios) / sizeof (scenarios[0]); ++i)
+    {
+      const Scenario &scenario = scenarios[i];
+      if (!only.empty () && only != scenario.name)
+        {
+          continue;
+        }
+      Result r = measure (scenario, acks, repeat, instructions);
+      std::cout << std::left << std::setw (14) << scenario.name << std::right << std::fixed
+                << std::setprecision (2) << std::setw (12) << r.nsPerAck
+                << std::setprecision (4) << std::setw (14) << r.allocsPerAck
+                << std::setprecision (1) << std::setw (14) << r.instrPerAck;
+      if (out.is_open ())
+        {
+          out << scenario.name << " " << r.nsPerAck << " " << r.allocsPerAck << " " << r.instrPerAck << std::endl;
+        }
+      std::map<std::string, Result>::const_iterator b = baseline.find (scenario.name);
+      if (b != baseline.end ())
+        {
+          const Result &base = b->second;
+          std::string verdict = "ok";
+          if (r.nsPerAck > base.nsPerAck * (1 + tolerance))
+            {
+              verdict = "SLOWER";
+            }
+          else if (base.instrPerAck >= 0 && r.instrPerAck >= 0 && r.instrPerAck > base.instrPerAck * (1 + tolerance))
+            {
+              verdict = "MORE INSTRUCTIONS";
+            }
+          else if (r.allocsPerAck > base.allocsPerAck + 1e-4)
+            {
+              verdict = "MORE ALLOCATIONS";
+            }
+          regressions += verdict != "ok";
+          std::cout << "  " << verdict << " (" << std::setprecision (2) << base.nsPerAck << " ns)";
+        }
+      std::cout << "  " << scenario.description << std::endl;
+    }
+
+  if (regressions)
+    {
+      std::cout << regressions << " scenario(s) regressed past the baseline" << std::endl;
+      return 1;
+    }
+  return 0;
+}
@@ -7,95 +7,998 @@
 #include "ns3/applications-module.h"
 #include "ns3/packet-sink-helper.h"
 #include "ns3/uinteger.h"
-#include "ns3/point-to-point-dumbbell.h"
 #include "ns3/tcp-cdg.h"
 #include "ns3/ptr.h"
 #include "ns3/csma-module.h"
+#include "ns3/traffic-control-module.h"
+#include "tcp-cdg-rtt-histogram.h"
+#include "tcp-cdg-trace-recorder.h"
+#include "tcp-cdg-pcap-ring.h"
+#include "tcp-cdg-profiler.h"
 #include <fstream>
+#include <sstream>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#ifdef NS3_MPI
+#include <mpi.h>
+#include "ns3/mpi-interface.h"
+#endif
 
 using namespace ns3;
 uint32_t qsize=0;
+// Time-weighted bottleneck occupancy: packet-nanoseconds up to the last
+// queue change, the time of that change, and the peak.
+double queue_area = 0;
+int64_t queue_last_ns = 0;
+uint32_t queue_max = 0;
 bool printRTT = false;
 bool printQueue = false;
-std::vector<int64_t> rtt_records;
+// Per-flow and aggregate RTT distributions, in nanoseconds. Each is a
+// bounded-memory streaming histogram, so long runs do not accumulate samples.
+std::vector<RttHistogram> flow_rtt;
+RttHistogram rtt_all;
+// Time packets spent in the bottleneck AQM, in nanoseconds (--aqm only).
+RttHistogram aqm_sojourn;
+// Binary time-series recorder, only set when --recordFile is given.
+TraceRecorder *recorder = 0;
+// Triggered in-memory captures (--pcapRing) and what fires them.
+std::vector<PcapRing *> pcap_rings;
+uint32_t pcap_trigger_queue = 0;
+bool pcap_trigger_backoff = false;
+// CDG backoffs of the run: how many, when the first one came and the spacing
+// of consecutive backoffs of each flow, for comparing gradient filters.
+uint64_t backoff_count = 0;
+int64_t backoff_first_ns = -1;
+std::vector<int64_t> backoff_last_ns;
+double backoff_interval_sum_ns = 0;
+uint64_t backoff_intervals = 0;
+// This process's rank and the number of ranks of a distributed (--mpi) run.
+uint32_t mpi_rank = 0;
+uint32_t mpi_ranks = 1;
+
+void trigger_pcap_rings()
+{
+  for (uint32_t i = 0; i < pcap_rings.size (); ++i)
+    {
+      pcap_rings[i]->Trigger ();
+    }
+}
+
+void pcap_backoff_trigger(uint32_t flow, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+  trigger_pcap_rings ();
+}
+
+void count_backoff(uint32_t flow, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+  if (backoff_first_ns < 0)
+    {
+      backoff_first_ns = now;
+    }
+  if (flow >= backoff_last_ns.size ())
+    {
+      backoff_last_ns.resize (flow + 1, -1);
+    }
+  if (backoff_last_ns[flow] >= 0)
+    {
+      backoff_interval_sum_ns += now - backoff_last_ns[flow];
+      ++backoff_intervals;
+    }
+  backoff_last_ns[flow] = now;
+  ++backoff_count;
+}
 
 void queue_callback(uint32_t oldValue, uint32_t newValue) {
    if (printQueue) {
      std::cout << "Packets in queue:" << newValue << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl; 
    }
+   if (recorder) {
+     recorder->Record (Simulator::Now ().GetNanoSeconds (), TRACE_NO_FLOW, TRACE_QUEUE_PACKETS, newValue);
+   }
+   if (pcap_trigger_queue && newValue >= pcap_trigger_queue && oldValue < pcap_trigger_queue) {
+     trigger_pcap_rings ();
+   }
+   int64_t now = Simulator::Now ().GetNanoSeconds ();
+   queue_area += double (qsize) * (now - queue_last_ns);
+   queue_last_ns = now;
+   queue_max = std::max (queue_max, newValue);
    qsize = newValue;
 }
 
-void trace_rtt(int64_t rtt)
+void trace_sojourn(Time sojourn)
+{
+  aqm_sojourn.Add (sojourn.GetNanoSeconds ());
+}
+
+void trace_rtt(uint32_t flow, Time oldValue, Time newValue)
 {
+  int64_t rtt = newValue.GetNanoSeconds ();
   if (printRTT) {
    std::cout << "RTT:" << rtt << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl; 
   }
-   rtt_records.push_back(rtt);
+   if (recorder) {
+     recorder->Record (Simulator::Now ().GetNanoSeconds (), flow, TRACE_RTT_NS, rtt);
+   }
+   flow_rtt[flow].Add (rtt);
+   rtt_all.Add (rtt);
 } 
 
+void record_cwnd(uint32_t flow, uint32_t oldValue, uint32_t newValue)
+{
+  recorder->Record (Simulator::Now ().GetNanoSeconds (), flow, TRACE_CWND_BYTES, newValue);
+}
+
+void record_cdg_state(uint32_t flow, TcpCDG::cdg_state oldValue, TcpCDG::cdg_state newValue)
+{
+  recorder->Record (Simulator::Now ().GetNanoSeconds (), flow, TRACE_CDG_STATE, newValue);
+}
+
+void record_cdg_backoff(uint32_t flow, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+  recorder->Record (Simulator::Now ().GetNanoSeconds (), flow, TRACE_CDG_BACKOFF, grad);
+}
+
 uint32_t getQSize() { return qsize; }
 
-int main (int argc, char *argv[])
+// Sinks for the TcpCDG trace sources; only the ones named in --cdgTraces
+// are connected, so unused sources cost nothing.
+void cdg_gradient_trace(uint32_t flow, int32_t gmin, int32_t gmax)
+{
+   std::cout << "CDG gradient:" << flow << ":" << gmin << ":" << gmax << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+void cdg_smoothed_gradient_trace(uint32_t flow, int32_t gmin, int32_t gmax)
+{
+   std::cout << "CDG smoothed gradient:" << flow << ":" << gmin << ":" << gmax << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+void cdg_state_trace(uint32_t flow, TcpCDG::cdg_state oldValue, TcpCDG::cdg_state newValue)
+{
+   std::cout << "CDG state:" << flow << ":" << newValue << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+void cdg_backoff_counter_trace(uint32_t flow, uint32_t oldValue, uint32_t newValue)
+{
+   std::cout << "CDG backoff count:" << flow << ":" << newValue << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+void cdg_backoff_trace(uint32_t flow, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+   std::cout << "CDG backoff:" << flow << ":" << grad << ":" << cwnd << ":" << ssThresh << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+void cdg_loss_window_trace(uint32_t flow, uint32_t oldValue, uint32_t newValue)
+{
+   std::cout << "CDG loss cwnd:" << flow << ":" << newValue << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+void cdg_slow_start_exit_trace(uint32_t flow, uint32_t reason, uint32_t cwnd)
+{
+   std::cout << "CDG slow start exit:" << flow << ":" << (reason == TcpCDG::HYSTART_ACK_TRAIN ? "ack-train" : "delay") << ":" << cwnd << ":at time:" << ns3::Simulator::Now().GetMicroSeconds() << std::endl;
+}
+
+bool hasToken(const std::string &list, const std::string &token)
+{
+  std::istringstream ss (list);
+  std::string item;
+  while (std::getline (ss, item, ','))
+    {
+      if (item == token)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+// The congestion control of a BulkSend socket is only reachable once the
+// application has created it, so this runs just after the sources start.
+// The socket gets its own TcpCDG instance, with a backoff RNG stream keyed
+// by the flow index, whose trace sources are hooked up before the
+// handshake completes.
+void installCdg(Ptr<TcpSocketBase> socket, uint32_t flow, int64_t streamBase, std::string traces, bool profile)
+{
+  Ptr<TcpCDG> cdg = CreateObject<TcpCDG> ();
+  cdg->AssignStreams (streamBase + flow);
+  if (profile)
+    {
+      Ptr<ProfiledCongestionOps> profiled = CreateObject<ProfiledCongestionOps> ();
+      profiled->SetInner (cdg);
+      socket->SetCongestionControlAlgorithm (profiled);
+    }
+  else
+    {
+      socket->SetCongestionControlAlgorithm (cdg);
+    }
+  cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&count_backoff, flow));
+
+  if (hasToken (traces, "Gradient"))
+    cdg->TraceConnectWithoutContext ("Gradient", MakeBoundCallback (&cdg_gradient_trace, flow));
+  if (hasToken (traces, "SmoothedGradient"))
+    cdg->TraceConnectWithoutContext ("SmoothedGradient", MakeBoundCallback (&cdg_smoothed_gradient_trace, flow));
+  if (hasToken (traces, "State"))
+    cdg->TraceConnectWithoutContext ("State", MakeBoundCallback (&cdg_state_trace, flow));
+  if (hasToken (traces, "BackoffCounter"))
+    cdg->TraceConnectWithoutContext ("BackoffCounter", MakeBoundCallback (&cdg_backoff_counter_trace, flow));
+  if (hasToken (traces, "Backoff"))
+    cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&cdg_backoff_trace, flow));
+  if (hasToken (traces, "LossWindow"))
+    cdg->TraceConnectWithoutContext ("LossWindow", MakeBoundCallback (&cdg_loss_window_trace, flow));
+  if (hasToken (traces, "SlowStartExit"))
+    cdg->TraceConnectWithoutContext ("SlowStartExit", MakeBoundCallback (&cdg_slow_start_exit_trace, flow));
+  if (pcap_trigger_backoff && !pcap_rings.empty ())
+    cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&pcap_backoff_trigger, flow));
+  if (recorder)
+    {
+      cdg->TraceConnectWithoutContext ("State", MakeBoundCallback (&record_cdg_state, flow));
+      cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&record_cdg_backoff, flow));
+    }
+}
+
+// Periodic goodput sampler. Every interval it reads the byte counters of the
+// local sinks and turns the deltas into per-flow goodput, Jain's fairness
+// index over the flows that were active for the whole interval, bottleneck
+// utilisation and the share of the bytes carried by CDG flows. Only the
+// previous counter of each flow and running summaries are kept; rows go to
+// an optional CSV file as they are produced.
+struct GoodputSampler
+{
+  GoodputSampler ()
+    : out (0), linkBps (0), samples (0), jainSamples (0),
+      jainSum (0), jainMin (1), utilSum (0)
+  {
+  }
+
+  // Flow i of 'sinks' is a CDG flow if isCdg[i], starts at startTimes[i]
+  // and is complete once sizes[i] bytes arrived (0 is unlimited).
+  void Start (const ApplicationContainer &sinkApps, const std::vector<bool> &cdg,
+              const std::vector<Time> &starts, const std::vector<uint64_t> &flowSizes,
+              Time every, double bottleneckBps, std::ostream *file)
+  {
+    for (uint32_t i = 0; i < sinkApps.GetN (); ++i)
+      {
+        sinks.push_back (DynamicCast<PacketSink> (sinkApps.Get (i)));
+      }
+    isCdg = cdg;
+    startTimes = starts;
+    sizes = flowSizes;
+    last.assign (sinks.size (), 0);
+    interval = every;
+    linkBps = bottleneckBps;
+    out = file;
+    if (out)
+      {
+        *out << "time_s,utilisation,jain,cdg_share";
+        for (uint32_t i = 0; i < sinks.size (); ++i)
+          {
+            *out << ",flow" << i << "_mbps";
+          }
+        *out << "\n";
+      }
+    Simulator::Schedule (interval, &GoodputSampler::Sample, this);
+  }
+
+  void Sample (void)
+  {
+    double seconds = interval.GetSeconds ();
+    Time intervalStart = Simulator::Now () - interval;
+    double total = 0, cdgBytes = 0, sum = 0, sumSq = 0;
+    uint32_t active = 0;
+    if (out)
+      {
+        row.str ("");
+      }
+    for (uint32_t i = 0; i < sinks.size (); ++i)
+      {
+        uint64_t rx = sinks[i]->GetTotalRx ();
+        double delta = rx - last[i];
+        bool complete = sizes[i] && last[i] >= sizes[i];
+        if (startTimes[i] <= intervalStart && !complete)
+          {
+            ++active;
+            sum += delta;
+            sumSq += delta * delta;
+          }
+        total += delta;
+        if (isCdg[i])
+          {
+            cdgBytes += delta;
+          }
+        last[i] = rx;
+        if (out)
+          {
+            row << "," << delta * 8 / seconds / 1e6;
+          }
+      }
+    double util = linkBps > 0 ? total * 8 / seconds / linkBps : 0;
+    double jain = sumSq > 0 ? sum * sum / (active * sumSq) : 1;
+    ++samples;
+    utilSum += util;
+    if (active > 1)
+      {
+        ++jainSamples;
+        jainSum += jain;
+        jainMin = std::min (jainMin, jain);
+      }
+    if (out)
+      {
+        *out << Simulator::Now ().GetSeconds () << "," << util << "," << jain << ","
+             << (total > 0 ? cdgBytes / total : 0) << row.str () << "\n";
+      }
+    Simulator::Schedule (interval, &GoodputSampler::Sample, this);
+  }
+
+  std::vector<Ptr<PacketSink> > sinks;
+  std::vector<bool> isCdg;
+  std::vector<Time> startTimes;
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> last;
+  std::ostringstream row;
+  std::ostream *out;
+  Time interval;
+  double linkBps;
+  uint64_t samples;
+  uint64_t jainSamples;
+  double jainSum;
+  double jainMin;
+  double utilSum;
+};
+
+// The PointToPointDumbbellHelper topology, built in the same node, device
+// and address order so node ids, pcap names and routes are unchanged, but
+// spread over 'systems' ranks: the left router stays on system 0 and the
+// right half (right router and leaves) goes to system 1, so with two systems
+// the router-to-router link is the only cut and its delay the lookahead.
+// With more, the left leaves are dealt round-robin over system 0 and
+// systems 2 and up (see LeftLeafSystem); their links to the left router are
+// cut too and the lookahead is the smaller of the leaf and bottleneck delays.
+struct Dumbbell
+{
+  Dumbbell (uint32_t nLeftLeaf, PointToPointHelper leftHelper,
+            uint32_t nRightLeaf, PointToPointHelper rightHelper,
+            PointToPointHelper bottleneckHelper, uint32_t systems)
+  {
+    uint32_t rightSystem = systems > 1 ? 1 : 0;
+    m_leftRouter.Create (1, 0);
+    m_rightRouter.Create (1, rightSystem);
+    for (uint32_t i = 0; i < nLeftLeaf; ++i)
+      {
+        m_leftLeaf.Create (1, LeftLeafSystem (i, systems));
+      }
+    m_rightLeaf.Create (nRightLeaf, rightSystem);
+
+    // Nodes on different systems get a remote channel from the helper
+    m_routerDevices = bottleneckHelper.Install (m_leftRouter.Get (0), m_rightRouter.Get (0));
+    for (uint32_t i = 0; i < nLeftLeaf; ++i)
+      {
+        NetDeviceContainer c = leftHelper.Install (m_leftRouter.Get (0), m_leftLeaf.Get (i));
+        m_leftRouterDevices.Add (c.Get (0));
+        m_leftLeafDevices.Add (c.Get (1));
+      }
+    for (uint32_t i = 0; i < nRightLeaf; ++i)
+      {
+        NetDeviceContainer c = rightHelper.Install (m_rightRouter.Get (0), m_rightLeaf.Get (i));
+        m_rightRouterDevices.Add (c.Get (0));
+        m_rightLeafDevices.Add (c.Get (1));
+      }
+  }
+
+  void InstallStack (InternetStackHelper &stack)
   {
+    stack.Install (m_leftRouter);
+    stack.Install (m_rightRouter);
+    stack.Install (m_leftLeaf);
+    stack.Install (m_rightLeaf);
+  }
+
+  void AssignIpv4Addresses (Ipv4AddressHelper leftIp, Ipv4AddressHelper rightIp, Ipv4AddressHelper routerIp)
+  {
+    m_routerInterfaces = routerIp.Assign (m_routerDevices);
+    for (uint32_t i = 0; i < m_leftLeaf.GetN (); ++i)
+      {
+        NetDeviceContainer ndc;
+        ndc.Add (m_leftLeafDevices.Get (i));
+        ndc.Add (m_leftRouterDevices.Get (i));
+        Ipv4InterfaceContainer ifc = leftIp.Assign (ndc);
+        m_leftLeafInterfaces.Add (ifc.Get (0));
+        m_leftRouterInterfaces.Add (ifc.Get (1));
+        leftIp.NewNetwork ();
+      }
+    for (uint32_t i = 0; i < m_rightLeaf.GetN (); ++i)
+      {
+        NetDeviceContainer ndc;
+        ndc.Add (m_rightLeafDevices.Get (i));
+        ndc.Add (m_rightRouterDevices.Get (i));
+        Ipv4InterfaceContainer ifc = rightIp.Assign (ndc);
+        m_rightLeafInterfaces.Add (ifc.Get (0));
+        m_rightRouterInterfaces.Add (ifc.Get (1));
+        rightIp.NewNetwork ();
+      }
+  }
+
+  // Routes for the dumbbell without a global shortest-path computation:
+  // every leaf has a default route to its router, and each router reaches
+  // the other side's leaves through one aggregated prefix across the
+  // bottleneck. Routes to the directly connected /30s are added by
+  // Ipv4StaticRouting itself, so setup is O(leaves).
+  void InstallStaticRoutes (Ipv4Address leftPrefix, Ipv4Address rightPrefix, Ipv4Mask sideMask)
+  {
+    Ipv4StaticRoutingHelper helper;
+    for (uint32_t i = 0; i < m_leftLeaf.GetN (); ++i)
+      {
+        GetRouting (helper, m_leftLeafDevices.Get (i))
+          ->SetDefaultRoute (m_leftRouterInterfaces.GetAddress (i), GetInterface (m_leftLeafDevices.Get (i)));
+      }
+    for (uint32_t i = 0; i < m_rightLeaf.GetN (); ++i)
+      {
+        GetRouting (helper, m_rightLeafDevices.Get (i))
+          ->SetDefaultRoute (m_rightRouterInterfaces.GetAddress (i), GetInterface (m_rightLeafDevices.Get (i)));
+      }
+    GetRouting (helper, m_routerDevices.Get (0))
+      ->AddNetworkRouteTo (rightPrefix, sideMask, m_routerInterfaces.GetAddress (1), GetInterface (m_routerDevices.Get (0)));
+    GetRouting (helper, m_routerDevices.Get (1))
+      ->AddNetworkRouteTo (leftPrefix, sideMask, m_routerInterfaces.GetAddress (0), GetInterface (m_routerDevices.Get (1)));
+  }
+
+  static Ptr<Ipv4StaticRouting> GetRouting (const Ipv4StaticRoutingHelper &helper, Ptr<NetDevice> device)
+  {
+    return helper.GetStaticRouting (device->GetNode ()->GetObject<Ipv4> ());
+  }
+
+  static uint32_t GetInterface (Ptr<NetDevice> device)
+  {
+    return device->GetNode ()->GetObject<Ipv4> ()->GetInterfaceForDevice (device);
+  }
+
+  // Senders share system 0 with the left router and get systems 2 and up
+  // to themselves; system 1 keeps the sinks, so goodput sampling stays local.
+  static uint32_t LeftLeafSystem (uint32_t i, uint32_t systems)
+  {
+    if (systems <= 2)
+      {
+        return 0;
+      }
+    uint32_t k = i % (systems - 1);
+    return k == 0 ? 0 : k + 1;
+  }
+
+  Ptr<Node> GetLeft (uint32_t i) const { return m_leftLeaf.Get (i); }
+  Ptr<Node> GetRight (uint32_t i) const { return m_rightLeaf.Get (i); }
+  Ipv4Address GetRightIpv4Address (uint32_t i) const { return m_rightLeafInterfaces.GetAddress (i); }
+
+  NodeContainer m_leftLeaf, m_leftRouter, m_rightLeaf, m_rightRouter;
+  NetDeviceContainer m_leftLeafDevices, m_leftRouterDevices;
+  NetDeviceContainer m_rightLeafDevices, m_rightRouterDevices;
+  NetDeviceContainer m_routerDevices;
+  Ipv4InterfaceContainer m_leftLeafInterfaces, m_leftRouterInterfaces;
+  Ipv4InterfaceContainer m_rightLeafInterfaces, m_rightRouterInterfaces;
+  Ipv4InterfaceContainer m_routerInterfaces;
+};
+
+// Everything a single dumbbell run depends on. A sweep point is applied to
+// a copy of this structure by name (see setParameter), so every field that
+// can be swept is listed in configColumns as well.
+struct ScenarioConfig
+{
   std::string tcpType = "CDG";
-  std::string socketType;
-  bool traceRTT=true;
-  uint32_t numLtNodes = 2;
-  uint32_t numRtNodes = 2;
+  double cdgFraction = 0.5;
   uint32_t queueSize = 500000;
-  uint32_t maxBytes   = 0;
-  uint32_t backoff_beta = 0.70 * 1024;
-  uint32_t backoff_factor = 333;
-  uint32_t ineffective_thresh = 5;
-  uint32_t ineffective_hold = 5;
-  uint32_t rtt_seq = 0;
-  uint32_t loss_cwnd = 0;
-  uint32_t backoff_cnt = 0;
-  uint32_t delack = 0;
+  std::string aqm = "none";
+  bool ecn = false;
+  uint32_t deviceQueue = 10;
+  uint32_t maxBytes = 0;
   uint32_t numBulkSendApps = 2;
-  //double emwa = 0.1, addstep = 4.0, beta = 0.01, thigh = 500, tlow = 50;
+  uint32_t numLeft = 2;
+  uint32_t numRight = 2;
+  std::string routing = "static";
+  std::string leafRate = "50Mbps";
+  std::string bottleneckRate = "50Mbps";
+  std::string leafDelay = "1us";
+  std::string bottleneckDelay = "1us";
+  std::string startMode = "fixed";
+  double startSpread = 1.0;
+  std::string flowSizes = "";
+  uint32_t backoffBeta = 0.70 * 1024;
+  uint32_t backoffFactor = 333;
+  uint32_t ineffectiveThresh = 5;
+  uint32_t ineffectiveHold = 5;
+  std::string rttResolution = "us";
+  bool useShadow = true;
+  bool lossTolerance = false;
+  uint32_t hystartDetect = 3;
+  std::string gradientFilter = TcpCDG::MAX_WINDOW ? "window" : "ewma";
+  uint32_t ewmaShift = 2;
+  uint32_t cwndClamp = 0;
+  uint32_t scalableWindow = 0;
+  uint32_t ackAggregation = 0;
+  bool cdgTimestamps = false;
+  uint32_t segmentSize = 536;
+  uint32_t socketBuffer = 131072;
+  bool pacing = false;
+  double simTime = 10.0;
+  uint32_t run = 1;
+  int64_t streamBase = 1000;
+  std::string cdgTraces = "";
+  std::string recordFile = "";
+  uint32_t recordDecimate = 1;
+  double recordIntervalUs = 0;
+  std::string pcap = "all";
+  std::string pcapPrefix = "Dumbbell";
+  uint32_t pcapSnapLen = 0;
+  bool pcapPromisc = true;
+  uint32_t pcapRing = 0;
+  uint32_t pcapTriggerQueue = 0;
+  bool pcapTriggerBackoff = false;
+  double pcapPostTriggerMs = 10;
+  uint32_t pcapMaxTriggers = 1;
+  double sampleIntervalMs = 100;
+  std::string sampleFile = "";
+  std::string scheduler = "map";
+  bool profile = false;
+};
 
-  // Parse command line arguments
-  CommandLine cmd;
-  cmd.AddValue ("tcpType",    "TCP type (use NewReno or CDG)",      tcpType);
-  cmd.AddValue ("tracing",    "Flag to enable/disable tracing",          traceRTT);
-  cmd.AddValue ("queueSize",    "Queue limit on the bottleneck link",      queueSize);
-  cmd.AddValue ("maxBytes",   "Max bytes soure will send",               maxBytes);
-  cmd.AddValue ("numBulkSendApps", "Number of BulkSendApps",             numBulkSendApps);
-  cmd.AddValue ("printRTT", "Get RTT timestamps", printRTT);
-  cmd.AddValue ("printQueue","Get Queue occupancy state",printQueue);
-  cmd.Parse(argc, argv);
+// Named result values of one run, in output column order, plus the raw
+// per-flow byte counts. Columns added with addProcess depend on the host
+// or on how the run is split over processes (timings, memory, event
+// queues) rather than on the simulated network alone.
+struct ScenarioResult
+{
+  std::vector<std::string> names;
+  std::vector<std::string> values;
+  std::vector<bool> simulated;
+  std::vector<uint64_t> flowRxBytes;
+
+  template <typename T>
+  void add (const std::string &name, const T &value)
+  {
+    std::ostringstream os;
+    os << value;
+    names.push_back (name);
+    values.push_back (os.str ());
+    simulated.push_back (true);
+  }
+
+  template <typename T>
+  void addProcess (const std::string &name, const T &value)
+  {
+    add (name, value);
+    simulated.back () = false;
+  }
+};
+
+template <typename T>
+bool parseValue (const std::string &text, T &value)
+{
+  std::istringstream is (text);
+  is >> value;
+  return !is.fail () && is.eof ();
+}
+
+bool parseValue (const std::string &text, bool &value)
+{
+  if (text == "1" || text == "true")
+    {
+      value = true;
+      return true;
+    }
+  if (text == "0" || text == "false")
+    {
+      value = false;
+      return true;
+    }
+  return false;
+}
+
+bool parseValue (const std::string &text, std::string &value)
+{
+  value = text;
+  return true;
+}
+
+// Parse "a,b,c" or an inclusive integer range "a:b" into a list of values.
+std::vector<std::string> parseGridValues (const std::string &text)
+{
+  std::vector<std::string> values;
+  std::string::size_type colon = text.find (':');
+  int64_t first, last;
+  if (colon != std::string::npos
+      && parseValue (text.substr (0, colon), first)
+      && parseValue (text.substr (colon + 1), last))
+    {
+      for (int64_t v = first; v <= last; ++v)
+        {
+          std::ostringstream os;
+          os << v;
+          values.push_back (os.str ());
+        }
+      return values;
+    }
+  std::istringstream ss (text);
+  std::string item;
+  while (std::getline (ss, item, ','))
+    {
+      values.push_back (item);
+    }
+  return values;
+}
+
+bool setParameter (ScenarioConfig &config, const std::string &name, const std::string &value)
+{
+  if (name == "tcpType") return parseValue (value, config.tcpType);
+  if (name == "cdgFraction") return parseValue (value, config.cdgFraction);
+  if (name == "queueSize") return parseValue (value, config.queueSize);
+  if (name == "aqm") return parseValue (value, config.aqm);
+  if (name == "ecn") return parseValue (value, config.ecn);
+  if (name == "deviceQueue") return parseValue (value, config.deviceQueue);
+  if (name == "maxBytes") return parseValue (value, config.maxBytes);
+  if (name == "numBulkSendApps") return parseValue (value, config.numBulkSendApps);
+  if (name == "numLeft") return parseValue (value, config.numLeft);
+  if (name == "numRight") return parseValue (value, config.numRight);
+  if (name == "routing") return parseValue (value, config.routing);
+  if (name == "leafRate") return parseValue (value, config.leafRate);
+  if (name == "bottleneckRate") return parseValue (value, config.bottleneckRate);
+  if (name == "leafDelay") return parseValue (value, config.leafDelay);
+  if (name == "bottleneckDelay") return parseValue (value, config.bottleneckDelay);
+  if (name == "startMode") return parseValue (value, config.startMode);
+  if (name == "startSpread") return parseValue (value, config.startSpread);
+  if (name == "flowSizes") return parseValue (value, config.flowSizes);
+  if (name == "backoffBeta") return parseValue (value, config.backoffBeta);
+  if (name == "backoffFactor") return parseValue (value, config.backoffFactor);
+  if (name == "ineffectiveThresh") return parseValue (value, config.ineffectiveThresh);
+  if (name == "ineffectiveHold") return parseValue (value, config.ineffectiveHold);
+  if (name == "rttResolution") return parseValue (value, config.rttResolution);
+  if (name == "useShadow") return parseValue (value, config.useShadow);
+  if (name == "lossTolerance") return parseValue (value, config.lossTolerance);
+  if (name == "hystartDetect") return parseValue (value, config.hystartDetect);
+  if (name == "gradientFilter") return parseValue (value, config.gradientFilter);
+  if (name == "ewmaShift") return parseValue (value, config.ewmaShift);
+  if (name == "cwndClamp") return parseValue (value, config.cwndClamp);
+  if (name == "scalableWindow") return parseValue (value, config.scalableWindow);
+  if (name == "ackAggregation") return parseValue (value, config.ackAggregation);
+  if (name == "cdgTimestamps") return parseValue (value, config.cdgTimestamps);
+  if (name == "segmentSize") return parseValue (value, config.segmentSize);
+  if (name == "socketBuffer") return parseValue (value, config.socketBuffer);
+  if (name == "pacing") return parseValue (value, config.pacing);
+  if (name == "scheduler") return parseValue (value, config.scheduler);
+  if (name == "profile") return parseValue (value, config.profile);
+  if (name == "simTime") return parseValue (value, config.simTime);
+  if (name == "run") return parseValue (value, config.run);
+  return false;
+}
+
+void configColumns (const ScenarioConfig &config, ScenarioResult &columns)
+{
+  columns.add ("tcpType", config.tcpType);
+  columns.add ("cdgFraction", config.cdgFraction);
+  columns.add ("queueSize", config.queueSize);
+  columns.add ("aqm", config.aqm);
+  columns.add ("ecn", config.ecn);
+  columns.add ("deviceQueue", config.deviceQueue);
+  columns.add ("maxBytes", config.maxBytes);
+  columns.add ("numBulkSendApps", config.numBulkSendApps);
+  columns.add ("numLeft", config.numLeft);
+  columns.add ("numRight", config.numRight);
+  columns.add ("routing", config.routing);
+  columns.add ("leafRate", config.leafRate);
+  columns.add ("bottleneckRate", config.bottleneckRate);
+  columns.add ("leafDelay", config.leafDelay);
+  columns.add ("bottleneckDelay", config.bottleneckDelay);
+  columns.add ("startMode", config.startMode);
+  columns.add ("startSpread", config.startSpread);
+  // Quoted: the list itself contains commas.
+  columns.add ("flowSizes", "\"" + config.flowSizes + "\"");
+  columns.add ("backoffBeta", config.backoffBeta);
+  columns.add ("backoffFactor", config.backoffFactor);
+  columns.add ("ineffectiveThresh", config.ineffectiveThresh);
+  columns.add ("ineffectiveHold", config.ineffectiveHold);
+  columns.add ("rttResolution", config.rttResolution);
+  columns.add ("useShadow", config.useShadow);
+  columns.add ("lossTolerance", config.lossTolerance);
+  columns.add ("hystartDetect", config.hystartDetect);
+  columns.add ("gradientFilter", config.gradientFilter);
+  columns.add ("ewmaShift", config.ewmaShift);
+  columns.add ("cwndClamp", config.cwndClamp);
+  columns.add ("scalableWindow", config.scalableWindow);
+  columns.add ("ackAggregation", config.ackAggregation);
+  columns.add ("cdgTimestamps", config.cdgTimestamps);
+  columns.add ("segmentSize", config.segmentSize);
+  columns.add ("socketBuffer", config.socketBuffer);
+  columns.add ("pacing", config.pacing);
+  columns.add ("scheduler", config.scheduler);
+  columns.add ("profile", config.profile);
+  columns.add ("simTime", config.simTime);
+  columns.add ("run", config.run);
+}
+
+// With tcpType Mixed, a cdgFraction share of the flows, spread evenly over
+// the flow indices, runs CDG and the rest keep the NewReno default.
+bool flowIsCdg (const ScenarioConfig &config, uint32_t flow)
+{
+  if (config.tcpType == "Mixed")
+    {
+      return uint32_t ((flow + 1) * config.cdgFraction) > uint32_t (flow * config.cdgFraction);
+    }
+  return config.tcpType == "CDG";
+}
+
+// Flow i ends at right leaf i % numRight, so its port only has to be unique
+// on that leaf: the flows of each sink node count up from 9000.
+uint16_t flowPort (const ScenarioConfig &config, uint32_t flow)
+{
+  uint32_t nth = flow / std::max (1U, config.numRight);
+  if (nth > 65535 - 9000)
+    {
+      NS_FATAL_ERROR ("Flow " << flow << " would need port " << 9000 + nth << " on its sink; use more right leaves");
+    }
+  return uint16_t (9000 + nth);
+}
+
+// Per-flow hooks installed once the BulkSend socket exists.
+void setupFlow(Ptr<Application> app, uint32_t flow, const ScenarioConfig *config)
+{
+  Ptr<TcpSocketBase> socket = DynamicCast<TcpSocketBase> (DynamicCast<BulkSendApplication> (app)->GetSocket ());
+  socket->TraceConnectWithoutContext ("RTT", MakeBoundCallback (&trace_rtt, flow));
+  if (recorder)
+    {
+      socket->TraceConnectWithoutContext ("CongestionWindow", MakeBoundCallback (&record_cwnd, flow));
+    }
+  if (flowIsCdg (*config, flow))
+    {
+      installCdg (socket, flow, config->streamBase, config->cdgTraces, config->profile);
+    }
+}
+
+// Resolve a --pcap device list: none, all, leaves, bottleneck, or
+// left<i>/right<i> for the leaf-side device of a single leaf.
+NetDeviceContainer selectPcapDevices (const Dumbbell &dumbbell, const std::string &spec)
+{
+  NetDeviceContainer devices;
+  std::istringstream ss (spec);
+  std::string token;
+  uint32_t index;
+  while (std::getline (ss, token, ','))
+    {
+      if (token == "none" || token.empty ())
+        {
+          continue;
+        }
+      if (token == "leaves" || token == "all")
+        {
+          devices.Add (dumbbell.m_leftLeafDevices);
+          devices.Add (dumbbell.m_leftRouterDevices);
+          devices.Add (dumbbell.m_rightLeafDevices);
+          devices.Add (dumbbell.m_rightRouterDevices);
+        }
+      if (token == "bottleneck" || token == "all")
+        {
+          devices.Add (dumbbell.m_routerDevices);
+        }
+      if (token == "leaves" || token == "bottleneck" || token == "all")
+        {
+          continue;
+        }
+      if (token.compare (0, 4, "left") == 0 && parseValue (token.substr (4), index))
+        {
+          if (index >= dumbbell.m_leftLeafDevices.GetN ())
+            {
+              NS_FATAL_ERROR ("pcap device '" << token << "': there are only " << dumbbell.m_leftLeafDevices.GetN () << " left leaves");
+            }
+          devices.Add (dumbbell.m_leftLeafDevices.Get (index));
+        }
+      else if (token.compare (0, 5, "right") == 0 && parseValue (token.substr (5), index))
+        {
+          if (index >= dumbbell.m_rightLeafDevices.GetN ())
+            {
+              NS_FATAL_ERROR ("pcap device '" << token << "': there are only " << dumbbell.m_rightLeafDevices.GetN () << " right leaves");
+            }
+          devices.Add (dumbbell.m_rightLeafDevices.Get (index));
+        }
+      else
+        {
+          NS_FATAL_ERROR ("Unknown pcap device '" << token << "'");
+        }
+    }
+  return devices;
+}
+
+// Capture the selected devices, truncated to the snap length. Without a
+// ring every packet goes straight to the file; with one, packets are only
+// written around triggers.
+void enablePcap (const Dumbbell &dumbbell, const ScenarioConfig &config)
+{
+  NetDeviceContainer devices = selectPcapDevices (dumbbell, config.pcap);
+  // Rings hold every slot in memory on every selected device (all of them
+  // by default), so without an explicit snap length they keep headers only.
+  uint32_t snapLen = config.pcapSnapLen ? config.pcapSnapLen : config.pcapRing ? 128 : 65535;
+  std::string traceName = config.pcapPromisc ? "PromiscSniffer" : "Sniffer";
+  PcapHelper pcapHelper;
+  pcap_trigger_queue = config.pcapRing ? config.pcapTriggerQueue : 0;
+  pcap_trigger_backoff = config.pcapRing && config.pcapTriggerBackoff;
+  for (uint32_t i = 0; i < devices.GetN (); ++i)
+    {
+      Ptr<PointToPointNetDevice> device = DynamicCast<PointToPointNetDevice> (devices.Get (i));
+      if (device->GetNode ()->GetSystemId () != mpi_rank)
+        {
+          continue;
+        }
+      std::string fileName = pcapHelper.GetFilenameFromDevice (config.pcapPrefix, device);
+      if (config.pcapRing)
+        {
+          PcapRing *ring = new PcapRing (fileName, PcapHelper::DLT_PPP, config.pcapRing, snapLen,
+                                         MicroSeconds (config.pcapPostTriggerMs * 1000), config.pcapMaxTriggers);
+          device->TraceConnectWithoutContext (traceName, MakeCallback (&PcapRing::Capture, ring));
+          pcap_rings.push_back (ring);
+        }
+      else
+        {
+          Ptr<PcapFileWrapper> file = pcapHelper.CreateFile (fileName, std::ios::out, PcapHelper::DLT_PPP, snapLen);
+          pcapHelper.HookDefaultSink<PointToPointNetDevice> (device, traceName, file);
+        }
+    }
+}
+
+// Attribute names differ between ns-3 releases; a missing one only loses
+// that setting, so warn instead of aborting.
+void setDefaultIfSupported (const std::string &name, const AttributeValue &value)
+{
+  if (!Config::SetDefaultFailSafe (name, value))
+    {
+      std::cout << "Note: " << name << " is not supported by this ns-3 build, ignored" << std::endl;
+    }
+}
+
+// Root queue disc type of an --aqm name. The AQMs keep their own default
+// limits (tunable as --ns3::RedQueueDisc::MaxSize etc.); queueSize only
+// sizes the plain FIFO.
+std::string aqmTypeId (const ScenarioConfig &config)
+{
+  if (config.aqm == "red")
+    {
+      setDefaultIfSupported ("ns3::RedQueueDisc::LinkBandwidth", StringValue (config.bottleneckRate));
+      setDefaultIfSupported ("ns3::RedQueueDisc::LinkDelay", StringValue (config.bottleneckDelay));
+      setDefaultIfSupported ("ns3::RedQueueDisc::UseEcn", BooleanValue (config.ecn));
+      return "ns3::RedQueueDisc";
+    }
+  if (config.aqm == "codel")
+    {
+      setDefaultIfSupported ("ns3::CoDelQueueDisc::UseEcn", BooleanValue (config.ecn));
+      return "ns3::CoDelQueueDisc";
+    }
+  if (config.aqm == "fqcodel")
+    {
+      setDefaultIfSupported ("ns3::FqCoDelQueueDisc::UseEcn", BooleanValue (config.ecn));
+      return "ns3::FqCoDelQueueDisc";
+    }
+  NS_FATAL_ERROR ("Unknown aqm '" << config.aqm << "', expected none, red, codel or fqcodel");
+  return "";
+}
+
+// Event queue implementation of a --scheduler name.
+std::string schedulerTypeId (const ScenarioConfig &config)
+{
+  if (config.scheduler == "map") return "ns3::MapScheduler";
+  if (config.scheduler == "heap") return "ns3::HeapScheduler";
+  if (config.scheduler == "calendar") return "ns3::CalendarScheduler";
+  if (config.scheduler == "list") return "ns3::ListScheduler";
+  NS_FATAL_ERROR ("Unknown scheduler '" << config.scheduler << "', expected map, heap, calendar or list");
+  return "";
+}
+
+void addRttColumns (ScenarioResult &result, const std::string &prefix, const RttHistogram &h)
+{
+  result.add (prefix + "Samples", h.GetCount ());
+  result.add (prefix + "P50Us", h.GetQuantile (0.50) / 1000.0);
+  result.add (prefix + "P95Us", h.GetQuantile (0.95) / 1000.0);
+  result.add (prefix + "P99Us", h.GetQuantile (0.99) / 1000.0);
+  result.add (prefix + "P999Us", h.GetQuantile (0.999) / 1000.0);
+}
+
+ScenarioResult runScenario (const ScenarioConfig &config)
+{
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now ();
+  RngSeedManager::SetRun (config.run);
+  // The simulator is rebuilt after each Destroy (), so every run picks its
+  // event queue afresh. Profiling slips a counting wrapper in front of it.
+  ObjectFactory scheduler;
+  if (config.profile)
+    {
+      scheduler.SetTypeId ("ns3::ProfilingScheduler");
+      scheduler.Set ("Backend", TypeIdValue (TypeId::LookupByName (schedulerTypeId (config))));
+    }
+  else
+    {
+      scheduler.SetTypeId (schedulerTypeId (config));
+    }
+  Simulator::SetScheduler (scheduler);
+  ProfilingScheduler::ResetStats ();
+  ProfiledCongestionOps::ResetStats ();
+  // Rank 1 runs only the sinks, so it has nothing to record. Rank 0 has the
+  // bottleneck queue and its share of the sources; ranks 2 and up record
+  // their sources to <recordFile>.<rank>.
+  if (!config.recordFile.empty () && (mpi_ranks < 2 || mpi_rank != 1))
+    {
+      std::ostringstream name;
+      name << config.recordFile;
+      if (mpi_rank > 1)
+        {
+          name << "." << mpi_rank;
+        }
+      recorder = new TraceRecorder (name.str ());
+      if (!recorder->IsOpen ())
+        {
+          NS_FATAL_ERROR ("Cannot open trace file " << config.recordFile);
+        }
+      recorder->SetDecimation (config.recordDecimate);
+      recorder->SetMinInterval (int64_t (config.recordIntervalUs * 1000));
+    }
 
   // Set default values
- Config::SetDefault ("ns3::QueueBase::MaxPackets", UintegerValue(queueSize));
- socketType = "ns3::TcpSocketFactory";
+ Config::SetDefault ("ns3::DropTailQueue<Packet>::MaxSize", QueueSizeValue (QueueSize (QueueSizeUnit::PACKETS, config.queueSize)));
+ // The ns-3 defaults (536-byte segments, 128 KiB buffers) cap a flow far
+ // below the bandwidth-delay product of fast, long paths.
+ Config::SetDefault ("ns3::TcpSocket::SegmentSize", UintegerValue (config.segmentSize));
+ Config::SetDefault ("ns3::TcpSocket::SndBufSize", UintegerValue (config.socketBuffer));
+ Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue (config.socketBuffer));
+ // ECN needs the pinned release (see tcp-cdg.h); ns-3.31 renames this
+ // attribute UseEcn, and a run that only claims ECN is worse than none.
+ if (config.ecn)
+   {
+     Config::SetDefault ("ns3::TcpSocketBase::EcnMode", StringValue ("ClassicEcn"));
+   }
+ // Paced sockets send at TcpSocketState's current pacing rate, which CDG
+ // keeps at a multiple of cwnd/srtt; the NIC rate bounds it.
+ if (config.pacing)
+   {
+     setDefaultIfSupported ("ns3::TcpSocketState::EnablePacing", BooleanValue (true));
+     setDefaultIfSupported ("ns3::TcpSocketState::MaxPacingRate", StringValue (config.leafRate));
+   }
  
   // Set transport protocol based on user input
-  if (tcpType.compare("CDG") == 0)
-    {
-     std::cout << "\nSetting default protocol to Tcp-CDG" << std::endl;
-     Config::SetDefault("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpCDG::GetTypeId ()));
-     Config::SetDefault("ns3::TcpCDG::BackoffBeta", uint32_t(backoff_beta));
-     Config::SetDefault("ns3::TcpCDG::BackoffFactor", uint32_t(backoff_factor));
-     Config::SetDefault("ns3::TcpCDG::IneffectiveThresh", uint32_t(ineffective_thresh));
-     Config::SetDefault("ns3::TcpCDG::IneffectiveHold", uint32_t(ineffective_hold));
-     Config::SetDefault("ns3::TcpCDG::RTTSequence", uint32_t(rtt_seq));
-     Config::SetDefault("ns3::TcpCDG::LossCwnd", uint32_t(loss_cwnd));
-     Config::SetDefault("ns3::TcpCDG::BackoffCount", uint32_t(backoff_count));
-     Config::SetDefault("ns3::TcpCDG::Delack", uint32_t(delack));
-    
-     
-     /*Config::SetDefault("ns3::TcpCDG::QSizeCallback", CallbackValue(MakeCallback(&getQSize)));
-     Config::SetDefault("ns3::TcpCDG::EMWA", DoubleValue(emwa));
-     Config::SetDefault("ns3::TcpTimely::Addstep", DoubleValue(addstep));
-     Config::SetDefault("ns3::TcpTimely::Beta", DoubleValue(beta));
-     Config::SetDefault("ns3::TcpTimely::THigh", DoubleValue(thigh));
-     Config::SetDefault("ns3::TcpTimely::TLow", DoubleValue(tlow));
-     Config::SetDefault("ns3::TcpOptionTS::UseNS", BooleanValue(true));
-     Config::SetDefault("ns3::TcpSocketBase::ClockGranularity", TimeValue(Time("1ns")));*/
+  if (config.tcpType.compare("CDG") == 0 || config.tcpType.compare("Mixed") == 0)
+    {
+     // Either way the socket type stays NewReno: setupFlow gives every CDG
+     // sender its own TcpCDG, so TcpCDG instances are exactly the CDG
+     // senders and the memory columns are not inflated by replaced
+     // instances or by sinks, which never send data.
+     Config::SetDefault("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpNewReno::GetTypeId ()));
+     if (config.tcpType.compare("CDG") == 0)
+       {
+        std::cout << "\nSetting default protocol to Tcp-CDG" << std::endl;
+       }
+     else
+       {
+        std::cout << "\nSetting default protocol to Tcp-NewReno, with " << config.cdgFraction * 100 << "% of the flows on Tcp-CDG" << std::endl;
+       }
+     Config::SetDefault("ns3::TcpCDG::BackoffBeta", UintegerValue(config.backoffBeta));
+     Config::SetDefault("ns3::TcpCDG::BackoffFactor", UintegerValue(config.backoffFactor));
+     Config::SetDefault("ns3::TcpCDG::IneffectiveThresh", UintegerValue(config.ineffectiveThresh));
+     Config::SetDefault("ns3::TcpCDG::IneffectiveHold", UintegerValue(config.ineffectiveHold));
+     Config::SetDefault("ns3::TcpCDG::RttResolution", StringValue(config.rttResolution));
+     Config::SetDefault("ns3::TcpCDG::UseShadow", BooleanValue(config.useShadow));
+     Config::SetDefault("ns3::TcpCDG::LossTolerance", BooleanValue(config.lossTolerance));
+     Config::SetDefault("ns3::TcpCDG::HystartDetect", UintegerValue(config.hystartDetect));
+     Config::SetDefault("ns3::TcpCDG::GradientFilter", StringValue(config.gradientFilter));
+     Config::SetDefault("ns3::TcpCDG::EwmaShift", UintegerValue(config.ewmaShift));
+     if (config.cwndClamp)
+       Config::SetDefault("ns3::TcpCDG::CwndClamp", UintegerValue(config.cwndClamp));
+     Config::SetDefault("ns3::TcpCDG::ScalableWindow", UintegerValue(config.scalableWindow));
+     Config::SetDefault("ns3::TcpCDG::AckAggregation", UintegerValue(config.ackAggregation));
+     Config::SetDefault("ns3::TcpCDG::UseTimestamps", BooleanValue(config.cdgTimestamps));
+     // With the timestamp option on, TcpSocketBase measures RTTs from 1 ms
+     // timestamp echoes and CDG never sees a sub-millisecond sample. Off,
+     // the RTT comes from the send time of the acked segment.
+     Config::SetDefault("ns3::TcpSocketBase::Timestamp", BooleanValue(config.cdgTimestamps));
    } 
-  else if(tcpType.compare("NewReno") == 0)
+  else if(config.tcpType.compare("NewReno") == 0)
     {
      std::cout << "\nSetting default protocol to Tcp-NewReno" << std::endl;
      Config::SetDefault("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpNewReno::GetTypeId ()));
@@ -109,80 +1012,852 @@ int main (int argc, char *argv[])
     Config::SetDefault("ns3::TcpCongestionOps::TraceRTTCallback", CallbackValue(MakeCallback(&trace_rtt)));
     }*/
 
-  // using the dumbbell helper to setup left and right nodes with two routers in the middle
+  uint32_t numLtNodes = std::max (1U, config.numLeft);
+  uint32_t numRtNodes = std::max (1U, config.numRight);
+
+  // setting up left and right nodes with two routers in the middle; in a
+  // distributed run the right half lives on rank 1 and the left leaves are
+  // spread over the other ranks
   PointToPointHelper p2pLeaf, p2pRouters;
-  p2pLeaf.SetDeviceAttribute     ("DataRate", StringValue ("50Mbps"));
-  p2pLeaf.SetChannelAttribute    ("Delay",    StringValue ("1us"));
-  p2pRouters.SetDeviceAttribute  ("DataRate", StringValue ("50Mbps"));
-  p2pRouters.SetChannelAttribute ("Delay",    StringValue ("1us"));
-  PointToPointDumbbellHelper dumbbell (numLtNodes, p2pLeaf,numRtNodes, p2pLeaf,p2pRouters);
+  p2pLeaf.SetDeviceAttribute     ("DataRate", StringValue (config.leafRate));
+  p2pLeaf.SetChannelAttribute    ("Delay",    StringValue (config.leafDelay));
+  p2pRouters.SetDeviceAttribute  ("DataRate", StringValue (config.bottleneckRate));
+  p2pRouters.SetChannelAttribute ("Delay",    StringValue (config.bottleneckDelay));
+  if (config.aqm != "none")
+    {
+      // Keep the device queue short so packets wait in the AQM, not behind it
+      p2pRouters.SetQueue ("ns3::DropTailQueue<Packet>", "MaxSize", QueueSizeValue (QueueSize (QueueSizeUnit::PACKETS, config.deviceQueue)));
+    }
+  uint32_t rightSystem = mpi_ranks > 1 ? 1 : 0;
+  Dumbbell dumbbell (numLtNodes, p2pLeaf, numRtNodes, p2pLeaf, p2pRouters, mpi_ranks);
 
   // Adding TCP/IP stack to all nodes (Transmission Control Protocol / Internet Protocol)
   InternetStackHelper stack;
   dumbbell.InstallStack (stack);
 
-  // assigning IP addresses
-  Ipv4AddressHelper ltIps     = Ipv4AddressHelper ("10.1.1.0", "255.255.255.0");
-  Ipv4AddressHelper rtIps     = Ipv4AddressHelper ("10.2.1.0", "255.255.255.0");
-  Ipv4AddressHelper routerIps = Ipv4AddressHelper ("10.3.1.0", "255.255.255.0");
+  // assigning IP addresses, one /30 per point-to-point link so that up to
+  // 16384 leaves per side fit in each /16 without running into the next
+  Ipv4AddressHelper ltIps     = Ipv4AddressHelper ("10.1.0.0", "255.255.255.252");
+  Ipv4AddressHelper rtIps     = Ipv4AddressHelper ("10.2.0.0", "255.255.255.252");
+  Ipv4AddressHelper routerIps = Ipv4AddressHelper ("10.3.0.0", "255.255.255.252");
   dumbbell.AssignIpv4Addresses(ltIps, rtIps, routerIps);
 
-  uint16_t port = 9000;
+  // Address assignment installs the default root queue disc; replace it on
+  // the left router's side of the bottleneck.
+  Ptr<QueueDisc> aqm;
+  aqm_sojourn = RttHistogram ();
+  qsize = 0;
+  queue_area = 0;
+  queue_last_ns = 0;
+  queue_max = 0;
+  backoff_count = 0;
+  backoff_first_ns = -1;
+  backoff_last_ns.clear ();
+  backoff_interval_sum_ns = 0;
+  backoff_intervals = 0;
+  if (config.aqm != "none")
+    {
+      TrafficControlHelper tch;
+      tch.Uninstall (dumbbell.m_routerDevices.Get (0));
+      tch.SetRootQueueDisc (aqmTypeId (config));
+      aqm = tch.Install (dumbbell.m_routerDevices.Get (0)).Get (0);
+    }
 
   ApplicationContainer sourceApps;
+  std::vector<uint32_t> sourceFlows;	// flow index of each of sourceApps
   ApplicationContainer sinkApps;
 
-  for (uint16_t i=0; i<numBulkSendApps; ++i)
+  // Flow sizes are cycled over the flows; 0 means unlimited.
+  std::vector<uint32_t> sizes;
+  std::vector<std::string> sizeList = parseGridValues (config.flowSizes);
+  for (uint32_t i = 0; i < sizeList.size (); ++i)
+    {
+      uint32_t size;
+      if (!parseValue (sizeList[i], size))
+        {
+          NS_FATAL_ERROR ("Invalid flow size '" << sizeList[i] << "'");
+        }
+      sizes.push_back (size);
+    }
+  if (sizes.empty ())
+    {
+      sizes.push_back (config.maxBytes);
+    }
+
+  // Random start times use their own stream so they do not shift the
+  // per-flow CDG streams.
+  Ptr<UniformRandomVariable> startRng = CreateObject<UniformRandomVariable> ();
+  startRng->SetStream (config.streamBase - 1);
+
+  std::vector<Time> startTimes;
+  for (uint32_t i=0; i<config.numBulkSendApps; ++i)
     {
-    // Creating BulkSendApplication source using a BulkSendHelper, whose constructor specifies the protocol to use and the address of the    remote node to send traffic to. Installing it on the left most node    
-    BulkSendHelper source ("ns3::TcpSocketFactory",InetSocketAddress (dumbbell.GetRightIpv4Address (0), port + i));
-    source.SetAttribute ("MaxBytes", UintegerValue (maxBytes));
-    sourceApps.Add (source.Install (dumbbell.GetLeft (0)));
+    // Flows are spread round-robin over the leaves, so flow i runs from
+    // left leaf i % numLeft to right leaf i % numRight.
+    uint32_t left = i % numLtNodes;
+    uint32_t right = i % numRtNodes;
+    Time start = Seconds (0);
+    if (config.startMode == "staggered")
+      {
+        start = Seconds (config.startSpread * i / config.numBulkSendApps);
+      }
+    else if (config.startMode == "random")
+      {
+        start = Seconds (startRng->GetValue (0, config.startSpread));
+      }
+    else if (config.startMode != "fixed")
+      {
+        NS_FATAL_ERROR ("Unknown startMode '" << config.startMode << "'");
+      }
+    startTimes.push_back (start);
 
-    sourceApps.Start (Seconds (0));
-    sourceApps.Stop  (Seconds (10.0));
+    // Creating BulkSendApplication source using a BulkSendHelper, whose constructor specifies the protocol to use and the address of the    remote node to send traffic to.
+    // Applications are only installed on the rank owning their node.
+    if (dumbbell.GetLeft (left)->GetSystemId () == mpi_rank)
+      {
+        BulkSendHelper source ("ns3::TcpSocketFactory",InetSocketAddress (dumbbell.GetRightIpv4Address (right), flowPort (config, i)));
+        source.SetAttribute ("MaxBytes", UintegerValue (sizes[i % sizes.size ()]));
+        ApplicationContainer sourceApp = source.Install (dumbbell.GetLeft (left));
+        sourceApp.Start (start);
+        sourceApp.Stop  (Seconds (config.simTime));
+        sourceApps.Add (sourceApp);
+        sourceFlows.push_back (i);
+      }
 
-    // Creating PacketSinkApplication sink using a PacketSinkHelper, whose constructor specifies the protocol to use and the address of the sink.Installing it on the right-most node.
-    PacketSinkHelper sink ("ns3::TcpSocketFactory",InetSocketAddress (Ipv4Address::GetAny (), port+i));
-    sinkApps.Add (sink.Install (dumbbell.GetRight (0)));
-    sinkApps.Start (Seconds (0.0));
-    sinkApps.Stop  (Seconds (10.0));
+    // Creating PacketSinkApplication sink using a PacketSinkHelper, whose constructor specifies the protocol to use and the address of the sink.
+    if (mpi_rank == rightSystem)
+      {
+        PacketSinkHelper sink ("ns3::TcpSocketFactory",InetSocketAddress (Ipv4Address::GetAny (), flowPort (config, i)));
+        ApplicationContainer sinkApp = sink.Install (dumbbell.GetRight (right));
+        sinkApp.Start (Seconds (0.0));
+        sinkApp.Stop  (Seconds (config.simTime));
+        sinkApps.Add (sinkApp);
+      }
     }
 
-  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+  // The sampler runs where the sinks are
+  std::vector<bool> cdgFlows;
+  std::vector<uint64_t> flowBytes;
+  for (uint32_t i = 0; i < config.numBulkSendApps; ++i)
+    {
+      cdgFlows.push_back (flowIsCdg (config, i));
+      flowBytes.push_back (sizes[i % sizes.size ()]);
+    }
+  GoodputSampler sampler;
+  std::ofstream sampleOut;
+  if (config.sampleIntervalMs > 0 && sinkApps.GetN ())
+    {
+      if (!config.sampleFile.empty ())
+        {
+          sampleOut.open (config.sampleFile.c_str ());
+          if (!sampleOut)
+            {
+              NS_FATAL_ERROR ("Cannot open sample file " << config.sampleFile);
+            }
+        }
+      sampler.Start (sinkApps, cdgFlows, startTimes, flowBytes, MicroSeconds (config.sampleIntervalMs * 1000),
+                     DataRate (config.bottleneckRate).GetBitRate (), sampleOut.is_open () ? &sampleOut : 0);
+    }
 
-  Ptr<NetDevice> nd = dumbbell.m_rightLeafDevices.Get(0);
-  Ptr<PointToPointNetDevice> outgoingPort = DynamicCast<PointToPointNetDevice>(nd);
-  Ptr<QueueBase> q = outgoingPort->GetQueue();
-  q->TraceConnectWithoutContext("PacketsInQueue", MakeCallback(&queue_callback));
+  flow_rtt.assign (config.numBulkSendApps, RttHistogram ());
+  rtt_all = RttHistogram ();
+  for (uint32_t i = 0; i < sourceApps.GetN (); ++i)
+    {
+      uint32_t flow = sourceFlows[i];
+      Simulator::Schedule (startTimes[flow] + NanoSeconds (1), &setupFlow, sourceApps.Get (i), flow, &config);
+    }
 
-  p2pLeaf.EnablePcapAll ("Dumbbell", true);
+  // The leaf /30s of each side are allocated from one /16 (see above).
+  // Global routing does all of its shortest-path work here, so the two
+  // methods are compared on this interval alone.
+  std::chrono::steady_clock::time_point routingStart = std::chrono::steady_clock::now ();
+  if (config.routing == "static")
+    {
+      dumbbell.InstallStaticRoutes (Ipv4Address ("10.1.0.0"), Ipv4Address ("10.2.0.0"), Ipv4Mask ("255.255.0.0"));
+    }
+  else if (config.routing == "global")
+    {
+      Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+    }
+  else
+    {
+      NS_FATAL_ERROR ("Unknown routing '" << config.routing << "'");
+    }
+  double routingSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - routingStart).count ();
+
+  // Left router side of the router-to-router link: the shared bottleneck.
+  // With an AQM the queue that matters is the AQM's.
+  if (aqm)
+    {
+      aqm->TraceConnectWithoutContext ("PacketsInQueue", MakeCallback (&queue_callback));
+      if (!aqm->TraceConnectWithoutContext ("SojournTime", MakeCallback (&trace_sojourn)))
+        {
+          std::cout << "Note: queue disc has no SojournTime trace, sojourn columns stay empty" << std::endl;
+        }
+    }
+  else
+    {
+      Ptr<NetDevice> nd = dumbbell.m_routerDevices.Get(0);
+      Ptr<PointToPointNetDevice> outgoingPort = DynamicCast<PointToPointNetDevice>(nd);
+      Ptr<QueueBase> q = outgoingPort->GetQueue();
+      q->TraceConnectWithoutContext("PacketsInQueue", MakeCallback(&queue_callback));
+    }
+
+  enablePcap (dumbbell, config);
 
   // Running simulation
   std::cout << "\nRuning simulation..." << std::endl;
-  Simulator::Stop (Seconds (10.0));
+  std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now ();
+  double setupSeconds = std::chrono::duration<double> (runStart - wallStart).count ();
+  Simulator::Stop (Seconds (config.simTime));
   Simulator::Run ();
+  double runSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - runStart).count ();
+  uint64_t events = Simulator::GetEventCount ();
+  // Read before Destroy (), which drains the event queue.
+  ProfilingScheduler::Stats queueStats = ProfilingScheduler::GetStats ();
+  uint64_t aqmDrops = aqm ? aqm->GetStats ().nTotalDroppedPackets : 0;
+  uint64_t aqmMarks = aqm ? aqm->GetStats ().nTotalMarkedPackets : 0;
   Simulator::Destroy ();
   std::cout << "\nSimulation finished!" << std::endl;
+  for (uint32_t i = 0; i < pcap_rings.size (); ++i)
+    {
+      delete pcap_rings[i];
+    }
+  pcap_rings.clear ();
+  if (recorder)
+    {
+      std::cout << "Recorded " << recorder->GetRecordsWritten () << " trace records" << std::endl;
+      delete recorder;
+      recorder = 0;
+    }
 
-  std::vector<uint32_t> throughputs;
-  uint32_t i = 0;
-  for(ApplicationContainer::Iterator it = sinkApps.Begin(); it != sinkApps.End(); ++it)
+  // Per-flow byte counts followed by the event count and the peak number of
+  // TcpCDG instances, one per CDG sender (see setupFlow). Ranks that
+  // do not own the sinks leave the counts at zero, so summing over ranks
+  // gathers them.
+  std::vector<uint64_t> counters (config.numBulkSendApps + 2, 0);
+  // Calls and nanoseconds of each CDG callback, in Callback order.
+  std::vector<uint64_t> profileCounters;
+  for (uint32_t cb = 0; cb < ProfiledCongestionOps::CB_COUNT; ++cb)
     {
-     Ptr<PacketSink> sink1 = DynamicCast<PacketSink>(*it);
-     uint32_t bytesRcvd = sink1->GetTotalRx ();
-     uint32_t tp =bytesRcvd;
-     throughputs.push_back(tp);
-     std::cout << "Throughput: " << throughputs.back() << " bps" <<" at port: "<<port+i<<std::endl;
-     ++i;
+      profileCounters.push_back (ProfiledCongestionOps::GetCalls (ProfiledCongestionOps::Callback (cb)));
+      profileCounters.push_back (ProfiledCongestionOps::GetNanoSeconds (ProfiledCongestionOps::Callback (cb)));
     }
- /*if (traceRTT) 
+  for (uint32_t i = 0; i < sinkApps.GetN (); ++i)
     {
-     std::cout<< "95th percentile RTT: ";
-     std::sort(rtt_records.begin(), rtt_records.end());
-     std::cout<< rtt_records.at((int)(rtt_records.size() * 0.95)) << std::endl;
-    }*/
-    
+      counters[i] = DynamicCast<PacketSink> (sinkApps.Get (i))->GetTotalRx ();
+    }
+  counters[config.numBulkSendApps] = events;
+  counters[config.numBulkSendApps + 1] = TcpCDG::GetPeakInstances ();
+#ifdef NS3_MPI
+  if (mpi_ranks > 1)
+    {
+      std::vector<uint64_t> local (counters);
+      MPI_Reduce (&local[0], &counters[0], counters.size (), MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+      events = counters[config.numBulkSendApps];
+      double local_summary[] = { double (sampler.samples), double (sampler.jainSamples), sampler.jainSum, sampler.utilSum };
+      double summary[4];
+      MPI_Reduce (local_summary, summary, 4, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      double jainMin;
+      MPI_Reduce (&sampler.jainMin, &jainMin, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+      sampler.samples = summary[0];
+      sampler.jainSamples = summary[1];
+      sampler.jainSum = summary[2];
+      sampler.utilSum = summary[3];
+      sampler.jainMin = jainMin;
+
+      // The senders, and with them the RTT samples and the CDG backoffs,
+      // are spread over every rank but 1; merge them at rank 0.
+      uint64_t localBackoffs[] = { backoff_count, backoff_intervals };
+      uint64_t backoffs[2];
+      MPI_Reduce (localBackoffs, backoffs, 2, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+      double intervalSum;
+      MPI_Reduce (&backoff_interval_sum_ns, &intervalSum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      uint64_t localFirst = backoff_first_ns < 0 ? std::numeric_limits<uint64_t>::max () : uint64_t (backoff_first_ns);
+      uint64_t first;
+      MPI_Reduce (&localFirst, &first, 1, MPI_UINT64_T, MPI_MIN, 0, MPI_COMM_WORLD);
+      backoff_count = backoffs[0];
+      backoff_intervals = backoffs[1];
+      backoff_interval_sum_ns = intervalSum;
+      backoff_first_ns = first == std::numeric_limits<uint64_t>::max () ? -1 : int64_t (first);
+
+      // Histograms differ in size, so every other rank sends its non-empty
+      // ones as (flow, words, image) triples in one message.
+      const int rttTag = 1;
+      if (mpi_rank != 0)
+        {
+          std::vector<uint64_t> images;
+          for (uint32_t i = 0; i < flow_rtt.size (); ++i)
+            {
+              if (flow_rtt[i].GetCount ())
+                {
+                  std::vector<uint64_t> image = flow_rtt[i].ToImage ();
+                  images.push_back (i);
+                  images.push_back (image.size ());
+                  images.insert (images.end (), image.begin (), image.end ());
+                }
+            }
+          MPI_Send (images.data (), images.size (), MPI_UINT64_T, 0, rttTag, MPI_COMM_WORLD);
+        }
+      else
+        {
+          for (uint32_t rank = 1; rank < mpi_ranks; ++rank)
+            {
+              MPI_Status status;
+              int words;
+              MPI_Probe (rank, rttTag, MPI_COMM_WORLD, &status);
+              MPI_Get_count (&status, MPI_UINT64_T, &words);
+              std::vector<uint64_t> images (words);
+              MPI_Recv (images.data (), words, MPI_UINT64_T, rank, rttTag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+              for (uint32_t at = 0; at + 2 <= images.size (); at += 2 + images[at + 1])
+                {
+                  RttHistogram h = RttHistogram::FromImage (&images[at + 2], images[at + 1]);
+                  flow_rtt[images[at]].Merge (h);
+                  rtt_all.Merge (h);
+                }
+            }
+        }
+
+      if (config.profile)
+        {
+          // Work adds up over the ranks; each rank has its own event queue.
+          std::vector<uint64_t> localProfile;
+          localProfile.push_back (queueStats.inserts);
+          localProfile.push_back (queueStats.removed);
+          localProfile.push_back (queueStats.queueNs);
+          for (uint32_t cb = 0; cb < ProfiledCongestionOps::CB_COUNT; ++cb)
+            {
+              localProfile.push_back (ProfiledCongestionOps::GetCalls (ProfiledCongestionOps::Callback (cb)));
+              localProfile.push_back (ProfiledCongestionOps::GetNanoSeconds (ProfiledCongestionOps::Callback (cb)));
+            }
+          std::vector<uint64_t> profile (localProfile.size ());
+          MPI_Reduce (&localProfile[0], &profile[0], profile.size (), MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+          uint64_t peakPending;
+          MPI_Reduce (&queueStats.peakPending, &peakPending, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+          queueStats.inserts = profile[0];
+          queueStats.removed = profile[1];
+          queueStats.queueNs = profile[2];
+          queueStats.peakPending = peakPending;
+          profileCounters.assign (profile.begin () + 3, profile.end ());
+        }
+    }
+#endif
+
+  ScenarioResult result;
+  uint64_t totalRx = 0;
+  uint64_t cdgRx = 0;
+  uint64_t minRx = std::numeric_limits<uint64_t>::max ();
+  uint64_t maxRx = 0;
+  for (uint32_t i = 0; i < config.numBulkSendApps; ++i)
+    {
+     uint64_t bytesRcvd = counters[i];
+     result.flowRxBytes.push_back (bytesRcvd);
+     totalRx += bytesRcvd;
+     cdgRx += cdgFlows[i] ? bytesRcvd : 0;
+     minRx = std::min (minRx, bytesRcvd);
+     maxRx = std::max (maxRx, bytesRcvd);
+    }
+  result.add ("flows", result.flowRxBytes.size ());
+  result.add ("totalRxBytes", totalRx);
+  result.add ("minFlowRxBytes", result.flowRxBytes.empty () ? 0 : minRx);
+  result.add ("maxFlowRxBytes", maxRx);
+  result.add ("goodputMbps", totalRx * 8.0 / config.simTime / 1e6);
+  result.add ("cdgShare", totalRx ? double (cdgRx) / totalRx : 0.0);
+  result.add ("meanUtilisation", sampler.samples ? sampler.utilSum / sampler.samples : 0.0);
+  result.add ("meanJain", sampler.jainSamples ? sampler.jainSum / sampler.jainSamples : 1.0);
+  result.add ("minJain", sampler.jainSamples ? sampler.jainMin : 1.0);
+  addRttColumns (result, "rtt", rtt_all);
+  queue_area += double (qsize) * (Seconds (config.simTime).GetNanoSeconds () - queue_last_ns);
+  result.add ("queueMeanPackets", queue_area / Seconds (config.simTime).GetNanoSeconds ());
+  result.add ("queueMaxPackets", queue_max);
+  result.add ("rttRelError", rtt_all.GetRelativeError ());
+  result.add ("cdgBackoffs", backoff_count);
+  result.add ("firstBackoffMs", backoff_first_ns < 0 ? 0.0 : backoff_first_ns / 1e6);
+  result.add ("meanBackoffIntervalMs", backoff_intervals ? backoff_interval_sum_ns / backoff_intervals / 1e6 : 0.0);
+  result.add ("aqmDrops", aqmDrops);
+  result.add ("aqmMarks", aqmMarks);
+  result.add ("sojournP50Us", aqm_sojourn.GetQuantile (0.50) / 1000.0);
+  result.add ("sojournP99Us", aqm_sojourn.GetQuantile (0.99) / 1000.0);
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  result.addProcess ("events", events);
+  result.addProcess ("eventsPerSec", runSeconds > 0 ? events / runSeconds : 0.0);
+  result.addProcess ("peakRssMb", usage.ru_maxrss / 1024.0);
+  uint64_t cdgInstances = counters[config.numBulkSendApps + 1];
+  result.add ("cdgPeakInstances", cdgInstances);
+  result.add ("cdgBytesPerInstance", TcpCDG::GetInstanceBytes ());
+  // The gradient ring is part of FlowState; a TCP_CDG_MAX_WINDOW=0 build
+  // (EWMA filter only) leaves it out, so compare builds, not filters.
+  result.add ("cdgFlowStateBytes", sizeof (TcpCDG::FlowState));
+  result.add ("cdgStateMb", cdgInstances * TcpCDG::GetInstanceBytes () / 1048576.0);
+  result.addProcess ("setupSeconds", setupSeconds);
+  result.addProcess ("routingSeconds", routingSeconds);
+  result.addProcess ("runSeconds", runSeconds);
+  // --profile columns; always present, and zero without it, so that sweep
+  // rows line up whatever the profile axis.
+  result.addProcess ("profSchedulerInserts", queueStats.inserts);
+  result.addProcess ("profSchedulerRemoved", queueStats.removed);
+  result.addProcess ("profPeakPendingEvents", queueStats.peakPending);
+  result.addProcess ("profQueueSeconds", queueStats.queueNs / 1e9);
+  uint64_t cdgCalls = 0;
+  uint64_t cdgNs = 0;
+  for (uint32_t cb = 0; cb < ProfiledCongestionOps::CB_COUNT; ++cb)
+    {
+      std::string name = ProfiledCongestionOps::GetCallbackName (ProfiledCongestionOps::Callback (cb));
+      result.addProcess ("profCdg" + name + "Calls", profileCounters[2 * cb]);
+      result.addProcess ("profCdg" + name + "Seconds", profileCounters[2 * cb + 1] / 1e9);
+      cdgCalls += profileCounters[2 * cb];
+      cdgNs += profileCounters[2 * cb + 1];
+    }
+  result.addProcess ("profCdgCalls", cdgCalls);
+  result.addProcess ("profCdgSeconds", cdgNs / 1e9);
+  result.addProcess ("profCdgShare", runSeconds > 0 ? cdgNs / 1e9 / runSeconds : 0.0);
+  result.addProcess ("profQueueShare", runSeconds > 0 ? queueStats.queueNs / 1e9 / runSeconds : 0.0);
+  result.addProcess ("wallSeconds", std::chrono::duration<double> (std::chrono::steady_clock::now () - wallStart).count ());
+  return result;
+}
+
+// The values a run is compared on: every simulated column, then the
+// bytes of each flow.
+std::vector<std::pair<std::string, std::string> > comparableResults (const ScenarioResult &result)
+{
+  std::vector<std::pair<std::string, std::string> > lines;
+  for (uint32_t i = 0; i < result.names.size (); ++i)
+    {
+      if (result.simulated[i])
+        {
+          lines.push_back (std::make_pair (result.names[i], result.values[i]));
+        }
+    }
+  for (uint32_t i = 0; i < result.flowRxBytes.size (); ++i)
+    {
+      std::ostringstream name, value;
+      name << "flowRxBytes" << i;
+      value << result.flowRxBytes[i];
+      lines.push_back (std::make_pair (name.str (), value.str ()));
+    }
+  return lines;
+}
+
+// One "name value" line per comparable value.
+void writeResults (const ScenarioResult &result, const std::string &fileName)
+{
+  std::ofstream out (fileName.c_str ());
+  if (!out)
+    {
+      NS_FATAL_ERROR ("Cannot write results to " << fileName);
+    }
+  std::vector<std::pair<std::string, std::string> > lines = comparableResults (result);
+  for (uint32_t i = 0; i < lines.size (); ++i)
+    {
+      out << lines[i].first << " " << lines[i].second << std::endl;
+    }
+}
+
+// Check a run against the --resultFile of another, e.g. a distributed run
+// against the serial one it must reproduce:
+//
+//   tcp-cdg-dumbell --resultFile=serial.txt
+//   mpirun -np 2 tcp-cdg-dumbell --mpi --compareWith=serial.txt
+//
+// Counts must match exactly; real values to the printed precision, since
+// sums gathered over ranks may round differently in the last digit.
+// Returns the exit status.
+int compareResults (const ScenarioResult &result, const std::string &fileName)
+{
+  std::ifstream in (fileName.c_str ());
+  if (!in)
+    {
+      NS_FATAL_ERROR ("Cannot open results " << fileName);
+    }
+  std::map<std::string, std::string> expected;
+  std::string name, value;
+  while (in >> name >> value)
+    {
+      expected[name] = value;
+    }
+  std::vector<std::pair<std::string, std::string> > lines = comparableResults (result);
+  uint32_t differ = 0;
+  for (uint32_t i = 0; i < lines.size (); ++i)
+    {
+      std::map<std::string, std::string>::iterator e = expected.find (lines[i].first);
+      if (e == expected.end ())
+        {
+          std::cout << "compare: " << lines[i].first << " missing from " << fileName << std::endl;
+          ++differ;
+          continue;
+        }
+      double a = std::strtod (lines[i].second.c_str (), 0);
+      double b = std::strtod (e->second.c_str (), 0);
+      bool real = (lines[i].second + e->second).find_first_of (".e") != std::string::npos;
+      if (lines[i].second != e->second
+          && (!real || std::fabs (a - b) > 1e-5 * std::max (std::fabs (a), std::fabs (b))))
+        {
+          std::cout << "compare: " << lines[i].first << " " << lines[i].second << ", expected " << e->second << std::endl;
+          ++differ;
+        }
+      expected.erase (e);
+    }
+  for (std::map<std::string, std::string>::iterator e = expected.begin (); e != expected.end (); ++e)
+    {
+      std::cout << "compare: " << e->first << " missing from this run" << std::endl;
+      ++differ;
+    }
+  std::cout << "compare: " << lines.size () << " values against " << fileName << ", " << differ << " differ" << std::endl;
+  return differ ? 1 : 0;
+}
+
+typedef std::vector<std::pair<std::string, std::string> > SweepPoint;
+
+// Expand "name=v1,v2;name2=a:b" into the cartesian product of its axes.
+std::vector<SweepPoint> expandGrid (const std::string &grid)
+{
+  std::vector<SweepPoint> points (1);
+  std::istringstream ss (grid);
+  std::string axis;
+  while (std::getline (ss, axis, ';'))
+    {
+      std::string::size_type eq = axis.find ('=');
+      if (axis.empty () || eq == std::string::npos)
+        {
+          NS_FATAL_ERROR ("Malformed sweep axis '" << axis << "', expected name=values");
+        }
+      std::string name = axis.substr (0, eq);
+      std::vector<std::string> values = parseGridValues (axis.substr (eq + 1));
+      std::vector<SweepPoint> expanded;
+      for (std::vector<SweepPoint>::const_iterator p = points.begin (); p != points.end (); ++p)
+        {
+          for (std::vector<std::string>::const_iterator v = values.begin (); v != values.end (); ++v)
+            {
+              SweepPoint point = *p;
+              point.push_back (std::make_pair (name, *v));
+              expanded.push_back (point);
+            }
+        }
+      points.swap (expanded);
+    }
+  return points;
+}
+
+// A sweep file holds one grid per line in the --sweep syntax; blank lines
+// and lines starting with '#' are ignored. All lines are concatenated.
+std::vector<SweepPoint> readSweepFile (const std::string &fileName)
+{
+  std::ifstream in (fileName.c_str ());
+  if (!in)
+    {
+      NS_FATAL_ERROR ("Cannot open sweep file " << fileName);
+    }
+  std::vector<SweepPoint> points;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      if (line.empty () || line[0] == '#')
+        {
+          continue;
+        }
+      std::vector<SweepPoint> linePoints = expandGrid (line);
+      points.insert (points.end (), linePoints.begin (), linePoints.end ());
+    }
+  return points;
+}
+
+std::string joinColumns (const std::vector<std::string> &columns)
+{
+  std::string line;
+  for (uint32_t i = 0; i < columns.size (); ++i)
+    {
+      line += (i ? "," : "") + columns[i];
+    }
+  return line;
+}
+
+// Run every sweep point in its own forked worker process, at most 'jobs' at
+// a time, and merge the per-run result rows into one CSV file in point
+// order. The Simulator is a process-wide singleton, so the parent never
+// touches it; each child configures, runs and tears down one scenario.
+int runSweep (const ScenarioConfig &base, const std::vector<SweepPoint> &points,
+              uint32_t jobs, const std::string &output)
+{
+  for (uint32_t i = 0; i < points.size (); ++i)
+    {
+      ScenarioConfig check = base;
+      for (SweepPoint::const_iterator kv = points[i].begin (); kv != points[i].end (); ++kv)
+        {
+          if (!setParameter (check, kv->first, kv->second))
+            {
+              NS_FATAL_ERROR ("Invalid sweep parameter " << kv->first << "=" << kv->second);
+            }
+        }
+    }
+
+  std::cout << "Sweeping " << points.size () << " runs on " << jobs << " workers" << std::endl;
+  std::map<pid_t, uint32_t> running;
+  std::vector<int> status (points.size (), -1);
+  uint32_t next = 0;
+  while (next < points.size () || !running.empty ())
+    {
+      while (running.size () < jobs && next < points.size ())
+        {
+          std::fflush (stdout);
+          pid_t pid = fork ();
+          if (pid < 0)
+            {
+              NS_FATAL_ERROR ("fork() failed for sweep run " << next);
+            }
+          if (pid == 0)
+            {
+              ScenarioConfig config = base;
+              for (SweepPoint::const_iterator kv = points[next].begin (); kv != points[next].end (); ++kv)
+                {
+                  setParameter (config, kv->first, kv->second);
+                }
+              if (!config.recordFile.empty ())
+                {
+                  std::ostringstream name;
+                  name << config.recordFile << "." << next;
+                  config.recordFile = name.str ();
+                }
+              std::ostringstream pcapPrefix;
+              pcapPrefix << config.pcapPrefix << "-" << next;
+              config.pcapPrefix = pcapPrefix.str ();
+              if (!std::freopen ("/dev/null", "w", stdout))
+                {
+                  _exit (2);
+                }
+              ScenarioResult result;
+              configColumns (config, result);
+              ScenarioResult run = runScenario (config);
+              result.names.insert (result.names.end (), run.names.begin (), run.names.end ());
+              result.values.insert (result.values.end (), run.values.begin (), run.values.end ());
+              std::ostringstream part;
+              part << output << ".part" << next;
+              std::ofstream out (part.str ().c_str ());
+              out << joinColumns (result.names) << "\n" << joinColumns (result.values) << "\n";
+              out.close ();
+              _exit (out ? 0 : 1);
+            }
+          running[pid] = next++;
+        }
+      int childStatus;
+      pid_t done = waitpid (-1, &childStatus, 0);
+      if (done < 0)
+        {
+          break;
+        }
+      std::map<pid_t, uint32_t>::iterator it = running.find (done);
+      if (it != running.end ())
+        {
+          status[it->second] = WIFEXITED (childStatus) ? WEXITSTATUS (childStatus) : 128 + WTERMSIG (childStatus);
+          running.erase (it);
+        }
+    }
+
+  std::ofstream out (output.c_str ());
+  bool header = false;
+  uint32_t failed = 0;
+  for (uint32_t i = 0; i < points.size (); ++i)
+    {
+      std::ostringstream part;
+      part << output << ".part" << i;
+      std::ifstream in (part.str ().c_str ());
+      std::string names, values;
+      if (status[i] != 0 || !std::getline (in, names) || !std::getline (in, values))
+        {
+          std::cerr << "Sweep run " << i << " failed (status " << status[i] << ")" << std::endl;
+          ++failed;
+          continue;
+        }
+      if (!header)
+        {
+          out << "point," << names << "\n";
+          header = true;
+        }
+      out << i << "," << values << "\n";
+      in.close ();
+      std::remove (part.str ().c_str ());
+    }
+  std::cout << "Wrote " << points.size () - failed << " rows to " << output << std::endl;
+  return failed ? 1 : 0;
+}
+
+int main (int argc, char *argv[])
+  {
+  ScenarioConfig config;
+  bool traceRTT=true;
+  std::string sweep = "";
+  std::string sweepFile = "";
+  std::string sweepOutput = "cdg-sweep.csv";
+  uint32_t jobs = std::max (1U, std::thread::hardware_concurrency ());
+  bool mpi = false;
+  std::string resultFile = "";
+  std::string compareWith = "";
+  //double emwa = 0.1, addstep = 4.0, beta = 0.01, thigh = 500, tlow = 50;
+
+  // Parse command line arguments
+  CommandLine cmd;
+  cmd.AddValue ("tcpType",    "TCP type (use NewReno, CDG or Mixed)",      config.tcpType);
+  cmd.AddValue ("cdgFraction", "Share of the flows running CDG with tcpType Mixed", config.cdgFraction);
+  cmd.AddValue ("tracing",    "Flag to enable/disable tracing",          traceRTT);
+  cmd.AddValue ("queueSize",    "Queue limit on the bottleneck link",      config.queueSize);
+  cmd.AddValue ("aqm", "Queue discipline on the bottleneck: none, red, codel or fqcodel", config.aqm);
+  cmd.AddValue ("ecn", "Negotiate ECN on the sockets and let the AQM mark instead of drop", config.ecn);
+  cmd.AddValue ("deviceQueue", "Device queue of the bottleneck in packets when an AQM is used", config.deviceQueue);
+  cmd.AddValue ("maxBytes",   "Max bytes soure will send",               config.maxBytes);
+  cmd.AddValue ("numBulkSendApps", "Number of BulkSendApps",             config.numBulkSendApps);
+  cmd.AddValue ("numLeft", "Number of left (sender) leaves", config.numLeft);
+  cmd.AddValue ("numRight", "Number of right (receiver) leaves", config.numRight);
+  cmd.AddValue ("routing", "Route setup: static (dumbbell-aware default and prefix routes) or global. Compare their startup with "
+                "--sweep=\"routing=static,global\" at a large numLeft/numRight and a short simTime; routingSeconds is the column to read", config.routing);
+  cmd.AddValue ("leafRate", "Data rate of the leaf links", config.leafRate);
+  cmd.AddValue ("bottleneckRate", "Data rate of the router-to-router link", config.bottleneckRate);
+  cmd.AddValue ("leafDelay", "Delay of the leaf links", config.leafDelay);
+  cmd.AddValue ("bottleneckDelay", "Delay of the router-to-router link", config.bottleneckDelay);
+  cmd.AddValue ("startMode", "Flow start times: fixed (all at 0), staggered or random over startSpread", config.startMode);
+  cmd.AddValue ("startSpread", "Seconds over which staggered or random starts are spread", config.startSpread);
+  cmd.AddValue ("flowSizes", "Comma-separated flow sizes in bytes, cycled over the flows (0 is unlimited; default maxBytes)", config.flowSizes);
+  cmd.AddValue ("printRTT", "Get RTT timestamps", printRTT);
+  cmd.AddValue ("printQueue","Get Queue occupancy state",printQueue);
+  cmd.AddValue ("cdgTraces", "Comma-separated TcpCDG traces to print (Gradient,SmoothedGradient,State,BackoffCounter,Backoff,LossWindow,SlowStartExit)", config.cdgTraces);
+  cmd.AddValue ("streamBase", "First RNG stream number of the per-flow CDG backoff streams", config.streamBase);
+  cmd.AddValue ("rttResolution", "Unit of CDG RTT tracking (ms, us or ns)", config.rttResolution);
+  cmd.AddValue ("useShadow", "Let CDG restore its shadow window on losses after a backoff", config.useShadow);
+  cmd.AddValue ("lossTolerance", "Let ECN-capable CDG flows ignore losses while the queue looks non-full; for --aqm with --ecn only", config.lossTolerance);
+  cmd.AddValue ("hystartDetect", "CDG slow-start exit: 1 ACK train, 2 delay increase, 3 both, 0 off", config.hystartDetect);
+  cmd.AddValue ("gradientFilter", "CDG gradient smoothing, window or ewma (compare with --sweep=\"gradientFilter=window,ewma\")", config.gradientFilter);
+  cmd.AddValue ("ewmaShift", "CDG EWMA filter weight 2^-ewmaShift, 1 to 8", config.ewmaShift);
+  cmd.AddValue ("cwndClamp", "CDG cwnd clamp in segments; 0 leaves it unlimited", config.cwndClamp);
+  cmd.AddValue ("scalableWindow", "CDG window in segments above which CA grows by 1% per RTT; 0 disables", config.scalableWindow);
+  cmd.AddValue ("ackAggregation", "ACKs covering more segments than this only lower CDG's RTT minimum, e.g. 2 with delayed ACKs; 0 disables (default)", config.ackAggregation);
+  cmd.AddValue ("cdgTimestamps", "Negotiate TCP timestamps and let CDG take RTT samples from their echoes (1 ms resolution); off, CDG flows get per-segment sub-ms RTTs", config.cdgTimestamps);
+  cmd.AddValue ("segmentSize", "TCP segment size, bytes", config.segmentSize);
+  cmd.AddValue ("pacing", "Pace the senders at the rate CDG sets (compare with --sweep=\"pacing=0,1\")", config.pacing);
+  cmd.AddValue ("socketBuffer", "TCP send and receive buffers, bytes; raise to the BDP for fast paths", config.socketBuffer);
+  cmd.AddValue ("backoffBeta", "CDG multiplicative backoff factor, scaled by 1024", config.backoffBeta);
+  cmd.AddValue ("backoffFactor", "CDG backoff probability factor per microsecond of gradient", config.backoffFactor);
+  cmd.AddValue ("ineffectiveThresh", "CDG ineffective backoffs tolerated before ignoring delay", config.ineffectiveThresh);
+  cmd.AddValue ("ineffectiveHold", "CDG backoffs skipped once ineffectiveThresh is reached", config.ineffectiveHold);
+  cmd.AddValue ("recordFile", "Write queue, RTT, cwnd and CDG state samples to this binary trace (see tcp-cdg-trace-to-csv); "
+                "under --mpi ranks 2 and up write the flows they send to <file>.<rank>", config.recordFile);
+  cmd.AddValue ("recordDecimate", "Keep one in every n samples of each recorded series (CDG state changes and backoffs are always kept)", config.recordDecimate);
+  cmd.AddValue ("recordIntervalUs", "Minimum spacing between recorded samples of a series (CDG state changes and backoffs are always kept)", config.recordIntervalUs);
+  cmd.AddValue ("pcap", "Devices to capture: all (default), none, leaves, bottleneck, left<i>, right<i> (comma-separated)", config.pcap);
+  cmd.AddValue ("pcapPrefix", "Prefix of the pcap file names", config.pcapPrefix);
+  cmd.AddValue ("pcapSnapLen", "Bytes captured per packet, e.g. 64 for headers only (0: whole packets, or 128 with --pcapRing)", config.pcapSnapLen);
+  cmd.AddValue ("pcapPromisc", "Capture in promiscuous mode", config.pcapPromisc);
+  cmd.AddValue ("pcapRing", "Keep this many packets per device in memory and only write them around triggers (0 writes everything); "
+                "at most 1 GiB per device with the snap length", config.pcapRing);
+  cmd.AddValue ("pcapTriggerQueue", "Trigger ring captures when the bottleneck queue reaches this many packets", config.pcapTriggerQueue);
+  cmd.AddValue ("pcapTriggerBackoff", "Trigger ring captures on CDG backoffs", config.pcapTriggerBackoff);
+  cmd.AddValue ("pcapPostTriggerMs", "Milliseconds written directly after a trigger", config.pcapPostTriggerMs);
+  cmd.AddValue ("pcapMaxTriggers", "Triggers honoured per device", config.pcapMaxTriggers);
+  cmd.AddValue ("sampleIntervalMs", "Interval of the goodput and fairness sampler (0 disables it)", config.sampleIntervalMs);
+  cmd.AddValue ("sampleFile", "CSV file receiving one row of per-flow goodput, utilisation, Jain index and CDG share per sample", config.sampleFile);
+  cmd.AddValue ("scheduler", "Event queue: map, heap, calendar or list (compare with --sweep=\"scheduler=map,heap,calendar,list\")", config.scheduler);
+  cmd.AddValue ("profile", "Count event queue use and time the CDG callbacks (prof* columns)", config.profile);
+  cmd.AddValue ("simTime", "Simulated seconds per run", config.simTime);
+  cmd.AddValue ("run", "RNG run number", config.run);
+  cmd.AddValue ("sweep", "Parameter grid, e.g. \"backoffBeta=512,716;backoffFactor=42,333;run=1:10\"", sweep);
+  cmd.AddValue ("sweepFile", "File with one --sweep grid per line", sweepFile);
+  cmd.AddValue ("sweepOutput", "CSV file collecting one row per sweep run", sweepOutput);
+  cmd.AddValue ("jobs", "Worker processes used by a sweep", jobs);
+  cmd.AddValue ("mpi", "Run distributed over 2 or more MPI ranks: rank 1 takes the right half, the left leaves are dealt over the others. "
+                "With 2 ranks the cut is the bottleneck alone; with more, the leaf links are cut too and leafDelay bounds the lookahead", mpi);
+  cmd.AddValue ("resultFile", "Write the simulated result columns and per-flow bytes of a single run to this file", resultFile);
+  cmd.AddValue ("compareWith", "Compare a single run with a --resultFile of another and exit 1 on any difference; "
+                "e.g. a serial run's file against mpirun -np 2 ... --mpi", compareWith);
+  cmd.Parse(argc, argv);
+
+  if (mpi)
+    {
+#ifdef NS3_MPI
+      if (!sweep.empty () || !sweepFile.empty ())
+        {
+          NS_FATAL_ERROR ("--mpi cannot be combined with a sweep");
+        }
+      GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DistributedSimulatorImpl"));
+      MpiInterface::Enable (&argc, &argv);
+      mpi_rank = MpiInterface::GetSystemId ();
+      mpi_ranks = MpiInterface::GetSize ();
+      if (mpi_ranks < 2)
+        {
+          NS_FATAL_ERROR ("--mpi needs at least 2 ranks (left and right half of the dumbbell), got " << mpi_ranks);
+        }
+      // Results are gathered at rank 0, which does all the printing
+      if (mpi_rank != 0 && !std::freopen ("/dev/null", "w", stdout))
+        {
+          NS_FATAL_ERROR ("Cannot silence rank " << mpi_rank);
+        }
+#else
+      NS_FATAL_ERROR ("--mpi requires ns-3 built with --enable-mpi");
+#endif
+    }
+
+  if (!sweep.empty () || !sweepFile.empty ())
+    {
+      std::vector<SweepPoint> points;
+      if (!sweep.empty ())
+        {
+          points = expandGrid (sweep);
+        }
+      if (!sweepFile.empty ())
+        {
+          std::vector<SweepPoint> filePoints = readSweepFile (sweepFile);
+          points.insert (points.end (), filePoints.begin (), filePoints.end ());
+        }
+      return runSweep (config, points, std::max (1U, jobs), sweepOutput);
+    }
+
+  ScenarioResult result = runScenario (config);
+  int status = 0;
+  if (mpi_rank == 0 && !resultFile.empty ())
+    {
+      writeResults (result, resultFile);
+    }
+  if (mpi_rank == 0 && !compareWith.empty ())
+    {
+      status = compareResults (result, compareWith);
+    }
+  for (uint32_t i = 0; i < result.names.size (); ++i)
+    {
+      // Every column a sweep row would get; the --profile ones are all
+      // zero without it.
+      if (config.profile || result.names[i].compare (0, 4, "prof") != 0)
+        {
+          std::cout << result.names[i] << ": " << result.values[i] << std::endl;
+        }
+    }
+
+  for(uint32_t i = 0; i < result.flowRxBytes.size (); ++i)
+    {
+     std::cout << "Received: " << result.flowRxBytes[i] << " bytes ("
+               << result.flowRxBytes[i] * 8.0 / config.simTime / 1e6 << " Mbps) at port: "<<flowPort (config, i)<<std::endl;
+    }
+ if (traceRTT) 
+    {
+     // Quantiles come from the streaming histograms; each is within
+     // rtt_all.GetRelativeError () of the exact sample quantile.
+     std::cout << "RTT percentiles in us (relative error <= " << rtt_all.GetRelativeError () * 100 << "%)" << std::endl;
+     for (uint32_t i = 0; i <= flow_rtt.size (); ++i)
+       {
+         const RttHistogram &h = i < flow_rtt.size () ? flow_rtt[i] : rtt_all;
+         if (i < flow_rtt.size ())
+           std::cout << "flow " << i;
+         else
+           std::cout << "all";
+         std::cout << ": samples " << h.GetCount ()
+                   << " p50 " << h.GetQuantile (0.50) / 1000.0
+                   << " p95 " << h.GetQuantile (0.95) / 1000.0
+                   << " p99 " << h.GetQuantile (0.99) / 1000.0
+                   << " p99.9 " << h.GetQuantile (0.999) / 1000.0 << std::endl;
+       }
+    }
     
-  return 0;
+#ifdef NS3_MPI
+  if (mpi)
+    {
+      MpiInterface::Disable ();
+    }
+#endif
+  return status;
 }
@@ -0,0 +1,676 @@
+// Flow-level simulator of TcpCDG flows sharing one drop-tail bottleneck.
+//
+// The bottleneck queue is a fluid model advanced in fixed steps: every
+// flow sends cwnd / RTT, the queue grows by what arrives beyond the link
+// capacity, and what overflows the buffer is dropped from the flows in
+// proportion to what they sent. The senders are real TcpCDG instances,
+// driven through bare TcpSocketState objects with the calls TcpSocketBase
+// makes per ACK (PktsAcked, IncreaseWindow) and per loss (GetSsThresh), in
+// batches of ackSegments segments. No packets, nodes or devices exist, so
+// thousands of flows run in seconds.
+//
+// The parameters have the names and defaults of tcp-cdg-dumbell, so the
+// same command line describes both runs:
+//
+//   tcp-cdg-dumbell --numBulkSendApps=4 --simTime=20 --recordFile=ref.bin
+//   tcp-cdg-flowsim --numBulkSendApps=4 --simTime=20 --validate=ref.bin
+//
+// --validate compares the queue length and the cwnd of each flow, as
+// time-weighted means over bins of binMs, with the reference trace of a
+// packet-level run, and exits with status 1 if the mean queue or the mean
+// total cwnd differ by more than the tolerance. --recordFile writes the
+// fluid run in the TraceRecorder format, for tcp-cdg-trace-to-csv.
+#include <iostream>
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ns3/tcp-cdg.h"
+#include "tcp-cdg-trace-recorder.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+using namespace ns3;
+
+// PPP, IPv4 and TCP headers added to every segment on the wire.
+static const uint32_t HEADER_BYTES = 2 + 20 + 20;
+
+struct FlowSimConfig
+{
+  uint32_t numBulkSendApps = 2;
+  std::string tcpType = "CDG";
+  uint32_t queueSize = 500000;
+  std::string leafRate = "50Mbps";
+  std::string bottleneckRate = "50Mbps";
+  std::string leafDelay = "1us";
+  std::string bottleneckDelay = "1us";
+  std::string startMode = "fixed";
+  double startSpread = 1.0;
+  std::string flowSizes = "";
+  uint32_t segmentSize = 536;
+  uint32_t initialCwnd = 1;
+  uint32_t ackSegments = 2;
+  uint32_t backoffBeta = 0.70 * 1024;
+  uint32_t backoffFactor = 333;
+  uint32_t ineffectiveThresh = 5;
+  uint32_t ineffectiveHold = 5;
+  std::string rttResolution = "us";
+  bool useShadow = true;
+  uint32_t hystartDetect = 3;
+  uint32_t cwndClamp = 0;
+  uint32_t scalableWindow = 0;
+  double simTime = 10.0;
+  double stepUs = 0;
+  int64_t streamBase = 1000;
+  std::string recordFile = "";
+  double recordIntervalUs = 1000;
+  std::string validate = "";
+  double binMs = 100;
+  double tolerance = 0.25;
+};
+
+// One sender: its socket state and congestion control, the fractions of a
+// segment it has sent, had acknowledged and lost but not yet accounted
+// for, and the end of its current loss recovery.
+struct FluidFlow
+{
+  Ptr<TcpSocketState> tcb;
+  Ptr<TcpCDG> cdg;
+  double start;
+  uint64_t size;
+  uint64_t acked;
+  double ackCredit;
+  double lossCredit;
+  double recoverUntil;
+  uint32_t losses;
+  uint32_t backoffs;
+  uint32_t slowStartExits;
+  bool done;
+};
+
+// Time-weighted means of a piecewise-constant series over fixed bins.
+struct BinnedSeries
+{
+  BinnedSeries (double binSeconds, double duration)
+    : bin (binSeconds),
+      sum (uint32_t (std::ceil (duration / binSeconds)), 0.0),
+      covered (sum.size (), 0.0)
+  {
+  }
+
+  // Hold 'value' over [from, to).
+  void Add (double from, double to, double value)
+  {
+    while (from < to)
+      {
+        uint32_t b = uint32_t (from / bin);
+        if (b >= sum.size ())
+          {
+            return;
+          }
+        double end = std::min (to, (b + 1) * bin);
+        sum[b] += value * (end - from);
+        covered[b] += end - from;
+        from = end;
+      }
+  }
+
+  double Mean (uint32_t b) const
+  {
+    return covered[b] > 0 ? sum[b] / covered[b] : 0.0;
+  }
+
+  double bin;
+  std::vector<double> sum;
+  std::vector<double> covered;
+};
+
+void count_backoff (uint32_t *backoffs, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+  ++*backoffs;
+}
+
+void count_slow_start_exit (uint32_t *exits, uint32_t reason, uint32_t cwnd)
+{
+  ++*exits;
+}
+
+class FluidBottleneck
+{
+public:
+  FluidBottleneck (const FlowSimConfig &config)
+    : m_config (config),
+      m_queue (0),
+      m_queueSum (0),
+      m_drops (0),
+      m_ackCalls (0),
+      m_recorder (0),
+      m_lastRecord (-1),
+      m_queueBins (config.binMs / 1000, config.simTime)
+  {
+    double packetBits = (config.segmentSize + HEADER_BYTES) * 8.0;
+    m_capacity = DataRate (config.bottleneckRate).GetBitRate () / packetBits;
+    m_leafCapacity = DataRate (config.leafRate).GetBitRate () / packetBits;
+    // Propagation over leaf, bottleneck and leaf both ways, plus the
+    // serialization of one data packet on each of the three links.
+    m_baseRtt = 2 * (2 * Time (config.leafDelay).GetSeconds () + Time (config.bottleneckDelay).GetSeconds ())
+      + 2 / m_leafCapacity + 1 / m_capacity;
+    m_step = config.stepUs > 0 ? config.stepUs * 1e-6 : std::max (m_baseRtt / 4, 10e-6);
+  }
+
+  ~FluidBottleneck ()
+  {
+    delete m_recorder;
+  }
+
+  void AddFlow (double start, uint64_t size, uint32_t index)
+  {
+    FluidFlow flow;
+    flow.tcb = CreateObject<TcpSocketState> ();
+    flow.tcb->m_segmentSize = m_config.segmentSize;
+    flow.tcb->m_initialCWnd = m_config.initialCwnd;
+    flow.tcb->m_cWnd = m_config.initialCwnd * m_config.segmentSize;
+    flow.tcb->m_ssThresh = 0xffffffff;
+    flow.tcb->m_lastAckedSeq = SequenceNumber32 (1);
+    flow.tcb->m_nextTxSequence = flow.tcb->m_lastAckedSeq + flow.tcb->m_cWnd.Get ();
+    flow.tcb->m_highTxMark = flow.tcb->m_nextTxSequence;
+    flow.tcb->m_congState = TcpSocketState::CA_OPEN;
+    flow.cdg = CreateObject<TcpCDG> ();
+    flow.cdg->AssignStreams (m_config.streamBase + index);
+    flow.start = start;
+    flow.size = size;
+    flow.acked = 0;
+    flow.ackCredit = 0;
+    flow.lossCredit = 0;
+    flow.recoverUntil = 0;
+    flow.losses = 0;
+    flow.backoffs = 0;
+    flow.slowStartExits = 0;
+    flow.done = false;
+    m_flows.push_back (flow);
+    m_cwndBins.push_back (BinnedSeries (m_config.binMs / 1000, m_config.simTime));
+  }
+
+  // Connected once all flows exist, as the counters are bound by address.
+  void ConnectTraces (void)
+  {
+    for (uint32_t i = 0; i < m_flows.size (); ++i)
+      {
+        m_flows[i].cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&count_backoff, &m_flows[i].backoffs));
+        m_flows[i].cdg->TraceConnectWithoutContext ("SlowStartExit", MakeBoundCallback (&count_slow_start_exit, &m_flows[i].slowStartExits));
+      }
+  }
+
+  bool OpenRecorder (const std::string &fileName)
+  {
+    m_recorder = new TraceRecorder (fileName);
+    return m_recorder->IsOpen ();
+  }
+
+  void Start (void)
+  {
+    Simulator::Schedule (Seconds (0), &FluidBottleneck::Step, this);
+  }
+
+  // One Euler step of the fluid queue, then the ACKs and losses it implies.
+  void Step (void)
+  {
+    double now = Simulator::Now ().GetSeconds ();
+    double dt = m_step;
+    double rtt = m_baseRtt + m_queue / m_capacity;
+
+    m_arrivals.assign (m_flows.size (), 0.0);
+    double arriving = 0;
+    for (uint32_t i = 0; i < m_flows.size (); ++i)
+      {
+        FluidFlow &flow = m_flows[i];
+        if (flow.done || now < flow.start)
+          {
+            continue;
+          }
+        double window = double (flow.tcb->m_cWnd.Get ()) / m_config.segmentSize;
+        m_arrivals[i] = std::min (window / rtt, m_leafCapacity) * dt;
+        arriving += m_arrivals[i];
+      }
+
+    double queue = std::max (0.0, m_queue + arriving - m_capacity * dt);
+    double dropped = 0;
+    if (queue > m_config.queueSize)
+      {
+        dropped = queue - m_config.queueSize;
+        queue = m_config.queueSize;
+      }
+    m_queue = queue;
+    m_queueSum += queue * dt;
+    m_drops += dropped;
+    m_queueBins.Add (now, now + dt, queue);
+    Record (now, TRACE_NO_FLOW, TRACE_QUEUE_PACKETS, std::floor (queue));
+
+    Time sample = Seconds (m_baseRtt + queue / m_capacity);
+    for (uint32_t i = 0; i < m_flows.size (); ++i)
+      {
+        FluidFlow &flow = m_flows[i];
+        if (m_arrivals[i] <= 0)
+          {
+            continue;
+          }
+        double lost = arriving > 0 ? m_arrivals[i] * dropped / arriving : 0;
+        flow.ackCredit += m_arrivals[i] - lost;
+        flow.lossCredit += lost;
+        Acknowledge (flow, sample, now);
+        if (flow.lossCredit >= 1)
+          {
+            Lose (flow, now, rtt);
+          }
+        m_cwndBins[i].Add (now, now + dt, flow.tcb->m_cWnd.Get ());
+        Record (now, i, TRACE_CWND_BYTES, flow.tcb->m_cWnd.Get ());
+      }
+
+    if (now + dt < m_config.simTime)
+      {
+        Simulator::Schedule (Seconds (dt), &FluidBottleneck::Step, this);
+      }
+  }
+
+  void Report (std::ostream &os, double wallSeconds) const
+  {
+    double duration = m_config.simTime;
+    std::vector<double> goodput;
+    double total = 0, squares = 0;
+    uint64_t losses = 0, backoffs = 0, exits = 0;
+    for (uint32_t i = 0; i < m_flows.size (); ++i)
+      {
+        const FluidFlow &flow = m_flows[i];
+        double active = std::max (duration - flow.start, m_step);
+        double mbps = flow.acked * 8.0 / active / 1e6;
+        goodput.push_back (mbps);
+        total += mbps;
+        squares += mbps * mbps;
+        losses += flow.losses;
+        backoffs += flow.backoffs;
+        exits += flow.slowStartExits;
+      }
+    double jain = squares > 0 ? total * total / (m_flows.size () * squares) : 0;
+    double linkMbps = DataRate (m_config.bottleneckRate).GetBitRate () / 1e6;
+    double wireGoodput = double (m_config.segmentSize) / (m_config.segmentSize + HEADER_BYTES);
+
+    os << "flows " << m_flows.size () << ", base RTT " << m_baseRtt * 1e6 << " us, step " << m_step * 1e6
+       << " us, " << m_ackCalls << " ACK batches in " << wallSeconds << " s" << std::endl;
+    os << "goodput " << total << " Mbps (" << 100 * total / (linkMbps * wireGoodput) << "% of the link), Jain "
+       << jain << std::endl;
+    os << "mean queue " << m_queueSum / duration << " packets, " << uint64_t (m_drops) << " packets dropped, "
+       << losses << " loss events, " << backoffs << " backoffs, " << exits << " HyStart exits" << std::endl;
+    if (m_flows.size () <= 16)
+      {
+        for (uint32_t i = 0; i < m_flows.size (); ++i)
+          {
+            os << "flow " << i << ": " << goodput[i] << " Mbps, cwnd " << m_flows[i].tcb->m_cWnd.Get ()
+               << ", " << m_flows[i].losses << " losses, " << m_flows[i].backoffs << " backoffs" << std::endl;
+          }
+      }
+  }
+
+  const BinnedSeries &GetQueueBins (void) const
+  {
+    return m_queueBins;
+  }
+
+  const std::vector<BinnedSeries> &GetCwndBins (void) const
+  {
+    return m_cwndBins;
+  }
+
+private:
+  // Whole segments acknowledged so far go to the congestion control in
+  // batches of ackSegments, the way delayed ACKs arrive.
+  void Acknowledge (FluidFlow &flow, const Time &rtt, double now)
+  {
+    TcpSocketState *tcb = PeekPointer (flow.tcb);
+    uint32_t segment = m_config.segmentSize;
+    while (flow.ackCredit >= 1 && !flow.done)
+      {
+        uint32_t segments = std::min<uint32_t> (m_config.ackSegments, uint32_t (flow.ackCredit));
+        flow.ackCredit -= segments;
+        flow.acked += uint64_t (segments) * segment;
+        tcb->m_lastAckedSeq += segments * segment;
+        tcb->m_nextTxSequence = tcb->m_lastAckedSeq + tcb->m_cWnd.Get ();
+        tcb->m_highTxMark = tcb->m_nextTxSequence;
+        flow.cdg->PktsAcked (flow.tcb, segments, rtt);
+        ++m_ackCalls;
+        if (tcb->m_congState == TcpSocketState::CA_OPEN)
+          {
+            flow.cdg->IncreaseWindow (flow.tcb, segments);
+          }
+        else if (now >= flow.recoverUntil)
+          {
+            tcb->m_cWnd = tcb->m_ssThresh.Get ();
+            tcb->m_congState = TcpSocketState::CA_OPEN;
+            flow.cdg->CongestionStateSet (flow.tcb, TcpSocketState::CA_OPEN);
+          }
+        if (flow.size && flow.acked >= flow.size)
+          {
+            flow.done = true;
+          }
+      }
+  }
+
+  // A loss outside recovery sets the window to the congestion control's
+  // ssthresh for one RTT of fast recovery; losses during it are absorbed.
+  void Lose (FluidFlow &flow, double now, double rtt)
+  {
+    TcpSocketState *tcb = PeekPointer (flow.tcb);
+    flow.lossCredit -= std::floor (flow.lossCredit);
+    if (tcb->m_congState != TcpSocketState::CA_OPEN)
+      {
+        return;
+      }
+    uint32_t ssThresh = flow.cdg->GetSsThresh (flow.tcb, tcb->m_cWnd.Get ());
+    tcb->m_ssThresh = ssThresh;
+    tcb->m_cWnd = std::max (ssThresh, 2 * m_config.segmentSize);
+    tcb->m_congState = TcpSocketState::CA_RECOVERY;
+    flow.cdg->CongestionStateSet (flow.tcb, TcpSocketState::CA_RECOVERY);
+    flow.recoverUntil = now + rtt;
+    ++flow.losses;
+  }
+
+  void Record (double now, uint32_t flow, uint32_t metric, double value)
+  {
+    if (m_recorder)
+      {
+        int64_t ns = int64_t (now * 1e9);
+        if (flow == TRACE_NO_FLOW && ns - m_lastRecord < int64_t (m_config.recordIntervalUs * 1000))
+          {
+            return;
+          }
+        if (flow == TRACE_NO_FLOW)
+          {
+            m_lastRecord = ns;
+          }
+        m_recorder->Record (ns, flow, metric, value);
+      }
+  }
+
+  const FlowSimConfig &m_config;
+  std::vector<FluidFlow> m_flows;
+  std::vector<double> m_arrivals;
+  double m_capacity;      //!< bottleneck, packets/s
+  double m_leafCapacity;  //!< access links, packets/s
+  double m_baseRtt;       //!< seconds
+  double m_step;          //!< seconds
+  double m_queue;         //!< packets
+  double m_queueSum;
+  double m_drops;
+  uint64_t m_ackCalls;
+  TraceRecorder *m_recorder;
+  int64_t m_lastRecord;
+  BinnedSeries m_queueBins;
+  std::vector<BinnedSeries> m_cwndBins;
+};
+
+// Bin the queue and cwnd series of a TraceRecorder file the same way as
+// the fluid run. The series are piecewise constant between samples.
+bool readReference (const std::string &fileName, const FlowSimConfig &config, BinnedSeries &queue,
+                    std::vector<BinnedSeries> &cwnd)
+{
+  std::FILE *in = std::fopen (fileName.c_str (), "rb");
+  if (!in)
+    {
+      std::perror (fileName.c_str ());
+      return false;
+    }
+  TraceFileHeader header;
+  if (std::fread (&header, sizeof (header), 1, in) != 1
+      || std::memcmp (header.magic, "CDGTRACE", sizeof (header.magic)) != 0
+      || header.version != TRACE_FILE_VERSION
+      || header.recordSize != sizeof (TraceRecord))
+    {
+      std::fprintf (stderr, "%s: not a version %u CDG trace\n", fileName.c_str (), TRACE_FILE_VERSION);
+      std::fclose (in);
+      return false;
+    }
+
+  // Last (time, value) of the queue and of each flow's cwnd.
+  std::vector<double> lastTime (config.numBulkSendApps + 1, -1);
+  std::vector<double> lastValue (config.numBulkSendApps + 1, 0);
+  std::vector<TraceRecord> block (1 << 16);
+  size_t n;
+  while ((n = std::fread (&block[0], sizeof (TraceRecord), block.size (), in)) > 0)
+    {
+      for (size_t i = 0; i < n; ++i)
+        {
+          const TraceRecord &r = block[i];
+          uint32_t slot;
+          if (r.metric == TRACE_QUEUE_PACKETS && r.flow == TRACE_NO_FLOW)
+            {
+              slot = 0;
+            }
+          else if (r.metric == TRACE_CWND_BYTES && r.flow < config.numBulkSendApps)
+            {
+              slot = r.flow + 1;
+            }
+          else
+            {
+              continue;
+            }
+          double t = r.timeNs * 1e-9;
+          if (lastTime[slot] >= 0)
+            {
+              BinnedSeries &series = slot ? cwnd[slot - 1] : queue;
+              series.Add (lastTime[slot], t, lastValue[slot]);
+            }
+          lastTime[slot] = t;
+          lastValue[slot] = r.value;
+        }
+    }
+  std::fclose (in);
+  for (uint32_t slot = 0; slot < lastTime.size (); ++slot)
+    {
+      if (lastTime[slot] >= 0)
+        {
+          BinnedSeries &series = slot ? cwnd[slot - 1] : queue;
+          series.Add (lastTime[slot], config.simTime, lastValue[slot]);
+        }
+    }
+  return true;
+}
+
+struct Agreement
+{
+  double reference;  //!< mean of the reference series
+  double fluid;      //!< mean of the fluid series
+  double meanError;  //!< |fluid - reference| / reference
+  double nrmse;      //!< RMS of the per-bin differences / reference mean
+};
+
+// Compare over the bins both runs cover.
+Agreement compare (const BinnedSeries &reference, const BinnedSeries &fluid)
+{
+  double sumRef = 0, sumFluid = 0, sumSq = 0;
+  uint32_t bins = 0;
+  for (uint32_t b = 0; b < reference.sum.size () && b < fluid.sum.size (); ++b)
+    {
+      if (reference.covered[b] <= 0 || fluid.covered[b] <= 0)
+        {
+          continue;
+        }
+      double r = reference.Mean (b), f = fluid.Mean (b);
+      sumRef += r;
+      sumFluid += f;
+      sumSq += (f - r) * (f - r);
+      ++bins;
+    }
+  Agreement a = { 0, 0, 0, 0 };
+  if (bins)
+    {
+      a.reference = sumRef / bins;
+      a.fluid = sumFluid / bins;
+      double scale = std::max (std::fabs (a.reference), 1e-9);
+      a.meanError = std::fabs (a.fluid - a.reference) / scale;
+      a.nrmse = std::sqrt (sumSq / bins) / scale;
+    }
+  return a;
+}
+
+void printAgreement (const std::string &name, const Agreement &a)
+{
+  std::cout << std::left << std::setw (10) << name << std::right << std::setw (14) << a.reference
+            << std::setw (14) << a.fluid << std::setw (12) << a.meanError << std::setw (12) << a.nrmse << std::endl;
+}
+
+// The sum of the per-flow series, bin by bin.
+BinnedSeries total (const std::vector<BinnedSeries> &series, const FlowSimConfig &config)
+{
+  BinnedSeries sum (config.binMs / 1000, config.simTime);
+  for (uint32_t i = 0; i < series.size (); ++i)
+    {
+      for (uint32_t b = 0; b < sum.sum.size (); ++b)
+        {
+          sum.sum[b] += series[i].Mean (b) * sum.bin;
+          sum.covered[b] = sum.bin;
+        }
+    }
+  return sum;
+}
+
+int validate (const FlowSimConfig &config, const FluidBottleneck &fluid)
+{
+  BinnedSeries queue (config.binMs / 1000, config.simTime);
+  std::vector<BinnedSeries> cwnd (config.numBulkSendApps, BinnedSeries (config.binMs / 1000, config.simTime));
+  if (!readReference (config.validate, config, queue, cwnd))
+    {
+      return 2;
+    }
+  std::cout << std::endl << "validation against " << config.validate << ", " << config.binMs << " ms bins"
+            << std::endl;
+  std::cout << std::left << std::setw (10) << "series" << std::right << std::setw (14) << "reference"
+            << std::setw (14) << "fluid" << std::setw (12) << "meanErr" << std::setw (12) << "nrmse" << std::endl;
+  Agreement q = compare (queue, fluid.GetQueueBins ());
+  printAgreement ("queue", q);
+  Agreement w = compare (total (cwnd, config), total (fluid.GetCwndBins (), config));
+  printAgreement ("cwnd", w);
+  if (config.numBulkSendApps <= 16)
+    {
+      for (uint32_t i = 0; i < config.numBulkSendApps; ++i)
+        {
+          std::ostringstream name;
+          name << "cwnd[" << i << "]";
+          printAgreement (name.str (), compare (cwnd[i], fluid.GetCwndBins ()[i]));
+        }
+    }
+  bool pass = q.meanError <= config.tolerance && w.meanError <= config.tolerance;
+  std::cout << (pass ? "PASS" : "FAIL") << ": mean queue and total cwnd within " << 100 * config.tolerance
+            << "% of the reference" << std::endl;
+  return pass ? 0 : 1;
+}
+
+int main (int argc, char *argv[])
+{
+  FlowSimConfig config;
+
+  CommandLine cmd;
+  cmd.AddValue ("numBulkSendApps", "Number of flows", config.numBulkSendApps);
+  cmd.AddValue ("tcpType", "Congestion control; only CDG is modelled", config.tcpType);
+  cmd.AddValue ("queueSize", "Bottleneck buffer, packets", config.queueSize);
+  cmd.AddValue ("leafRate", "Access link rate", config.leafRate);
+  cmd.AddValue ("bottleneckRate", "Bottleneck link rate", config.bottleneckRate);
+  cmd.AddValue ("leafDelay", "Access link delay", config.leafDelay);
+  cmd.AddValue ("bottleneckDelay", "Bottleneck link delay", config.bottleneckDelay);
+  cmd.AddValue ("startMode", "Flow start times: fixed, staggered or random", config.startMode);
+  cmd.AddValue ("startSpread", "Seconds over which staggered or random starts are spread", config.startSpread);
+  cmd.AddValue ("flowSizes", "Comma-separated flow sizes in bytes, cycled over the flows; 0 is unlimited", config.flowSizes);
+  cmd.AddValue ("segmentSize", "TCP segment size, bytes", config.segmentSize);
+  cmd.AddValue ("initialCwnd", "Initial window, segments", config.initialCwnd);
+  cmd.AddValue ("ackSegments", "Segments acknowledged per ACK batch", config.ackSegments);
+  cmd.AddValue ("backoffBeta", "CDG backoff multiplier, scaled by 1024", config.backoffBeta);
+  cmd.AddValue ("backoffFactor", "CDG backoff probability scale", config.backoffFactor);
+  cmd.AddValue ("ineffectiveThresh", "CDG ineffective backoff threshold", config.ineffectiveThresh);
+  cmd.AddValue ("ineffectiveHold", "CDG ineffective backoff hold", config.ineffectiveHold);
+  cmd.AddValue ("rttResolution", "Unit of CDG RTT tracking (ms, us or ns)", config.rttResolution);
+  cmd.AddValue ("useShadow", "Let CDG restore its shadow window on losses after a backoff", config.useShadow);
+  cmd.AddValue ("hystartDetect", "CDG slow-start exit: 1 ACK train, 2 delay increase, 3 both, 0 off", config.hystartDetect);
+  cmd.AddValue ("cwndClamp", "CDG cwnd clamp in segments; 0 leaves it unlimited", config.cwndClamp);
+  cmd.AddValue ("scalableWindow", "CDG window in segments above which CA grows by 1% per RTT; 0 disables", config.scalableWindow);
+  cmd.AddValue ("simTime", "Simulated seconds", config.simTime);
+  cmd.AddValue ("stepUs", "Fluid step in microseconds; 0 uses a quarter of the base RTT", config.stepUs);
+  cmd.AddValue ("streamBase", "First RNG stream of the CDG backoff draws", config.streamBase);
+  cmd.AddValue ("recordFile", "Write queue and cwnd series to this binary trace", config.recordFile);
+  cmd.AddValue ("recordIntervalUs", "Minimum spacing of recorded queue samples", config.recordIntervalUs);
+  cmd.AddValue ("validate", "Compare with this tcp-cdg-dumbell --recordFile trace", config.validate);
+  cmd.AddValue ("binMs", "Bin width of the validation", config.binMs);
+  cmd.AddValue ("tolerance", "Allowed relative error of the mean queue and total cwnd", config.tolerance);
+  cmd.Parse (argc, argv);
+
+  if (config.tcpType != "CDG")
+    {
+      NS_FATAL_ERROR ("The fluid model only drives TcpCDG, not " << config.tcpType);
+    }
+  if (config.numBulkSendApps == 0 || config.ackSegments == 0 || config.binMs <= 0)
+    {
+      NS_FATAL_ERROR ("numBulkSendApps, ackSegments and binMs must be positive");
+    }
+
+  Config::SetDefault ("ns3::TcpCDG::BackoffBeta", UintegerValue (config.backoffBeta));
+  Config::SetDefault ("ns3::TcpCDG::BackoffFactor", UintegerValue (config.backoffFactor));
+  Config::SetDefault ("ns3::TcpCDG::IneffectiveThresh", UintegerValue (config.ineffectiveThresh));
+  Config::SetDefault ("ns3::TcpCDG::IneffectiveHold", UintegerValue (config.ineffectiveHold));
+  Config::SetDefault ("ns3::TcpCDG::RttResolution", StringValue (config.rttResolution));
+  Config::SetDefault ("ns3::TcpCDG::UseShadow", BooleanValue (config.useShadow));
+  Config::SetDefault ("ns3::TcpCDG::HystartDetect", UintegerValue (config.hystartDetect));
+  if (config.cwndClamp)
+    {
+      Config::SetDefault ("ns3::TcpCDG::CwndClamp", UintegerValue (config.cwndClamp));
+    }
+  Config::SetDefault ("ns3::TcpCDG::ScalableWindow", UintegerValue (config.scalableWindow));
+  std::vector<uint64_t> sizes;
+  std::istringstream sizeList (config.flowSizes);
+  std::string item;
+  while (std::getline (sizeList, item, ','))
+    {
+      sizes.push_back (std::strtoull (item.c_str (), 0, 10));
+    }
+  if (sizes.empty ())
+    {
+      sizes.push_back (0);
+    }
+
+  FluidBottleneck fluid (config);
+  Ptr<UniformRandomVariable> startRng = CreateObject<UniformRandomVariable> ();
+  startRng->SetStream (config.streamBase - 1);
+  for (uint32_t i = 0; i < config.numBulkSendApps; ++i)
+    {
+      double start = 0;
+      if (config.startMode == "staggered")
+        {
+          start = config.startSpread * i / config.numBulkSendApps;
+        }
+      else if (config.startMode == "random")
+        {
+          start = startRng->GetValue (0, config.startSpread);
+        }
+      else if (config.startMode != "fixed")
+        {
+          NS_FATAL_ERROR ("Unknown startMode '" << config.startMode << "'");
+        }
+      fluid.AddFlow (start, sizes[i % sizes.size ()], i);
+    }
+  fluid.ConnectTraces ();
+  if (!config.recordFile.empty () && !fluid.OpenRecorder (config.recordFile))
+    {
+      NS_FATAL_ERROR ("Cannot open trace file " << config.recordFile);
+    }
+
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now ();
+  fluid.Start ();
+  Simulator::Stop (Seconds (config.simTime));
+  Simulator::Run ();
+  double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - begin).count ();
+
+  fluid.Report (std::cout, wall);
+  int status = config.validate.empty () ? 0 : validate (config, fluid);
+  Simulator::Destroy ();
+  return status;
+}
@@ -0,0 +1,93 @@
+#include "tcp-cdg-pcap-ring.h"
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("PcapRing");
+
+// Largest ring buffer accepted, per device.
+static const uint64_t MAX_RING_BYTES = uint64_t (1) << 30;
+
+PcapRing::PcapRing (const std::string &fileName, uint32_t dataLinkType, uint32_t slots,
+                    uint32_t snapLen, Time postTrigger, uint32_t maxTriggers)
+  : m_slots (std::max (1U, slots)),
+    m_snapLen (std::max (1U, snapLen)),
+    m_postTrigger (postTrigger),
+    m_maxTriggers (maxTriggers),
+    m_triggers (0),
+    m_until (Seconds (-1)),
+    m_timeNs (m_slots),
+    m_length (m_slots),
+    m_head (0),
+    m_used (0)
+{
+  NS_LOG_FUNCTION (this << fileName << slots << snapLen);
+  uint64_t bytes = uint64_t (m_slots) * m_snapLen;
+  NS_ABORT_MSG_IF (bytes > MAX_RING_BYTES, "Pcap ring of " << m_slots << " slots of " << m_snapLen
+                   << " bytes exceeds " << MAX_RING_BYTES << " bytes; use fewer slots or a shorter snap length");
+  m_data.resize (size_t (bytes));
+  m_file.Open (fileName, std::ios::out | std::ios::binary);
+  NS_ABORT_MSG_IF (m_file.Fail (), "Cannot open " << fileName);
+  m_file.Init (dataLinkType, m_snapLen);
+}
+
+void
+PcapRing::Capture (Ptr<const Packet> packet)
+{
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+  uint32_t caplen = std::min (packet->GetSize (), m_snapLen);
+  if (Simulator::Now () <= m_until)
+    {
+      uint8_t *scratch = &m_data[0];
+      packet->CopyData (scratch, caplen);
+      Write (now, scratch, packet->GetSize ());
+      return;
+    }
+  if (m_triggers >= m_maxTriggers)
+    {
+      return;
+    }
+  uint8_t *slot = &m_data[size_t (m_head) * m_snapLen];
+  packet->CopyData (slot, caplen);
+  m_timeNs[m_head] = now;
+  m_length[m_head] = packet->GetSize ();
+  m_head = (m_head + 1) % m_slots;
+  m_used = std::min (m_used + 1, m_slots);
+}
+
+void
+PcapRing::Trigger (void)
+{
+  if (Simulator::Now () <= m_until || m_triggers >= m_maxTriggers)
+    {
+      return;
+    }
+  NS_LOG_FUNCTION (this << m_used);
+  ++m_triggers;
+  uint32_t first = (m_head + m_slots - m_used) % m_slots;
+  for (uint32_t i = 0; i < m_used; ++i)
+    {
+      uint32_t slot = (first + i) % m_slots;
+      Write (m_timeNs[slot], &m_data[size_t (slot) * m_snapLen], m_length[slot]);
+    }
+  m_used = 0;
+  m_head = 0;
+  m_until = Simulator::Now () + m_postTrigger;
+}
+
+uint32_t
+PcapRing::GetTriggerCount (void) const
+{
+  return m_triggers;
+}
+
+void
+PcapRing::Write (int64_t timeNs, const uint8_t *data, uint32_t totalLen)
+{
+  // PcapFile writes min (totalLen, snapLen) bytes, which is what each slot holds.
+  m_file.Write (uint32_t (timeNs / 1000000000), uint32_t ((timeNs / 1000) % 1000000), data, totalLen);
+}
+
+} // namespace ns3
@@ -0,0 +1,63 @@
+#ifndef TCP_CDG_PCAP_RING_H
+#define TCP_CDG_PCAP_RING_H
+
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/pcap-file.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * Triggered packet capture for one device. Packets are truncated to the
+ * snap length and kept in a fixed in-memory ring; nothing touches the disk
+ * until Trigger () is called. A trigger writes the ring contents (the
+ * packets leading up to the event) to the pcap file and then writes every
+ * packet directly for the post-trigger window. The ring is re-armed when
+ * the window closes, up to a maximum number of triggers.
+ */
+class PcapRing
+{
+public:
+  /**
+   * \param fileName pcap file to create
+   * \param dataLinkType pcap link type of the captured device
+   * \param slots packets kept before a trigger
+   * \param snapLen bytes kept per packet; slots * snapLen may not exceed
+   *        1 GiB
+   * \param postTrigger how long to keep writing after a trigger
+   * \param maxTriggers triggers honoured before the ring stops capturing
+   */
+  PcapRing (const std::string &fileName, uint32_t dataLinkType, uint32_t slots,
+            uint32_t snapLen, Time postTrigger, uint32_t maxTriggers);
+
+  /** Sniffer trace sink. */
+  void Capture (Ptr<const Packet> packet);
+
+  /** Dump the ring and open a post-trigger window at the current time. */
+  void Trigger (void);
+
+  uint32_t GetTriggerCount (void) const;
+
+private:
+  void Write (int64_t timeNs, const uint8_t *data, uint32_t totalLen);
+
+  PcapFile m_file;
+  uint32_t m_slots;
+  uint32_t m_snapLen;
+  Time m_postTrigger;
+  uint32_t m_maxTriggers;
+  uint32_t m_triggers;
+  Time m_until;
+  std::vector<uint8_t> m_data;      //!< m_slots * m_snapLen packet bytes
+  std::vector<int64_t> m_timeNs;    //!< capture time of each slot
+  std::vector<uint32_t> m_length;   //!< original length of each slot
+  uint32_t m_head;                  //!< next slot to overwrite
+  uint32_t m_used;                  //!< valid slots
+};
+
+} // namespace ns3
+
+#endif /* TCP_CDG_PCAP_RING_H */
@@ -0,0 +1,274 @@
+#include "tcp-cdg-profiler.h"
+#include "ns3/object-factory.h"
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include <chrono>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TcpCdgProfiler");
+
+namespace {
+
+ProfilingScheduler::Stats g_schedulerStats;
+uint64_t g_callbackCalls[ProfiledCongestionOps::CB_COUNT];
+uint64_t g_callbackNs[ProfiledCongestionOps::CB_COUNT];
+
+// Adds the wall time of its own lifetime to a counter.
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer (uint64_t &ns)
+    : m_ns (ns),
+      m_start (std::chrono::steady_clock::now ())
+  {
+  }
+
+  ~ScopedTimer ()
+  {
+    m_ns += std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now () - m_start).count ();
+  }
+
+private:
+  uint64_t &m_ns;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+} // anonymous namespace
+
+NS_OBJECT_ENSURE_REGISTERED (ProfilingScheduler);
+
+TypeId
+ProfilingScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::ProfilingScheduler")
+    .SetParent<Scheduler> ()
+    .SetGroupName ("Core")
+    .AddConstructor<ProfilingScheduler> ()
+    .AddAttribute ("Backend",
+                   "Scheduler implementation that holds the events",
+                   TypeIdValue (TypeId::LookupByName ("ns3::MapScheduler")),
+                   MakeTypeIdAccessor (&ProfilingScheduler::SetBackend,
+                                       &ProfilingScheduler::GetBackend),
+                   MakeTypeIdChecker ())
+  ;
+  return tid;
+}
+
+ProfilingScheduler::ProfilingScheduler ()
+{
+  SetBackend (TypeId::LookupByName ("ns3::MapScheduler"));
+}
+
+ProfilingScheduler::~ProfilingScheduler ()
+{
+}
+
+void
+ProfilingScheduler::SetBackend (TypeId tid)
+{
+  NS_ABORT_MSG_IF (m_backend && !m_backend->IsEmpty (),
+                   "Cannot change the backend of a non-empty ProfilingScheduler");
+  ObjectFactory factory;
+  factory.SetTypeId (tid);
+  m_backendId = tid;
+  m_backend = factory.Create<Scheduler> ();
+}
+
+TypeId
+ProfilingScheduler::GetBackend (void) const
+{
+  return m_backendId;
+}
+
+void
+ProfilingScheduler::Insert (const Event &ev)
+{
+  {
+    ScopedTimer timer (g_schedulerStats.queueNs);
+    m_backend->Insert (ev);
+  }
+  ++g_schedulerStats.inserts;
+  if (++g_schedulerStats.pending > g_schedulerStats.peakPending)
+    {
+      g_schedulerStats.peakPending = g_schedulerStats.pending;
+    }
+}
+
+bool
+ProfilingScheduler::IsEmpty (void) const
+{
+  return m_backend->IsEmpty ();
+}
+
+Scheduler::Event
+ProfilingScheduler::PeekNext (void) const
+{
+  ScopedTimer timer (g_schedulerStats.queueNs);
+  return m_backend->PeekNext ();
+}
+
+Scheduler::Event
+ProfilingScheduler::RemoveNext (void)
+{
+  ScopedTimer timer (g_schedulerStats.queueNs);
+  --g_schedulerStats.pending;
+  return m_backend->RemoveNext ();
+}
+
+void
+ProfilingScheduler::Remove (const Event &ev)
+{
+  ScopedTimer timer (g_schedulerStats.queueNs);
+  --g_schedulerStats.pending;
+  ++g_schedulerStats.removed;
+  m_backend->Remove (ev);
+}
+
+const ProfilingScheduler::Stats &
+ProfilingScheduler::GetStats (void)
+{
+  return g_schedulerStats;
+}
+
+void
+ProfilingScheduler::ResetStats (void)
+{
+  // Events already queued stay pending across the reset.
+  uint64_t pending = g_schedulerStats.pending;
+  g_schedulerStats = Stats ();
+  g_schedulerStats.pending = pending;
+  g_schedulerStats.peakPending = pending;
+}
+
+NS_OBJECT_ENSURE_REGISTERED (ProfiledCongestionOps);
+
+TypeId
+ProfiledCongestionOps::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::ProfiledCongestionOps")
+    .SetParent<TcpCongestionOps> ()
+    .SetGroupName ("Internet")
+    .AddConstructor<ProfiledCongestionOps> ()
+  ;
+  return tid;
+}
+
+ProfiledCongestionOps::ProfiledCongestionOps ()
+  : TcpCongestionOps ()
+{
+}
+
+ProfiledCongestionOps::ProfiledCongestionOps (const ProfiledCongestionOps &sock)
+  : TcpCongestionOps (sock),
+    m_inner (sock.m_inner->Fork ())
+{
+}
+
+ProfiledCongestionOps::~ProfiledCongestionOps ()
+{
+}
+
+void
+ProfiledCongestionOps::SetInner (Ptr<TcpCongestionOps> inner)
+{
+  m_inner = inner;
+}
+
+Ptr<TcpCongestionOps>
+ProfiledCongestionOps::GetInner (void) const
+{
+  return m_inner;
+}
+
+std::string
+ProfiledCongestionOps::GetName () const
+{
+  return m_inner->GetName ();
+}
+
+uint32_t
+ProfiledCongestionOps::GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight)
+{
+  ++g_callbackCalls[CB_GET_SS_THRESH];
+  ScopedTimer timer (g_callbackNs[CB_GET_SS_THRESH]);
+  return m_inner->GetSsThresh (tcb, bytesInFlight);
+}
+
+void
+ProfiledCongestionOps::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
+{
+  ++g_callbackCalls[CB_INCREASE_WINDOW];
+  ScopedTimer timer (g_callbackNs[CB_INCREASE_WINDOW]);
+  m_inner->IncreaseWindow (tcb, segmentsAcked);
+}
+
+void
+ProfiledCongestionOps::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time &rtt)
+{
+  ++g_callbackCalls[CB_PKTS_ACKED];
+  ScopedTimer timer (g_callbackNs[CB_PKTS_ACKED]);
+  m_inner->PktsAcked (tcb, segmentsAcked, rtt);
+}
+
+void
+ProfiledCongestionOps::CongestionStateSet (Ptr<TcpSocketState> tcb,
+                                           const TcpSocketState::TcpCongState_t newState)
+{
+  ++g_callbackCalls[CB_CONGESTION_STATE_SET];
+  ScopedTimer timer (g_callbackNs[CB_CONGESTION_STATE_SET]);
+  m_inner->CongestionStateSet (tcb, newState);
+}
+
+void
+ProfiledCongestionOps::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event)
+{
+  ++g_callbackCalls[CB_CWND_EVENT];
+  ScopedTimer timer (g_callbackNs[CB_CWND_EVENT]);
+  m_inner->CwndEvent (tcb, event);
+}
+
+Ptr<TcpCongestionOps>
+ProfiledCongestionOps::Fork ()
+{
+  return CopyObject<ProfiledCongestionOps> (this);
+}
+
+const char *
+ProfiledCongestionOps::GetCallbackName (Callback cb)
+{
+  switch (cb)
+    {
+    case CB_GET_SS_THRESH: return "GetSsThresh";
+    case CB_INCREASE_WINDOW: return "IncreaseWindow";
+    case CB_PKTS_ACKED: return "PktsAcked";
+    case CB_CONGESTION_STATE_SET: return "CongestionStateSet";
+    case CB_CWND_EVENT: return "CwndEvent";
+    default: return "Unknown";
+    }
+}
+
+uint64_t
+ProfiledCongestionOps::GetCalls (Callback cb)
+{
+  return g_callbackCalls[cb];
+}
+
+uint64_t
+ProfiledCongestionOps::GetNanoSeconds (Callback cb)
+{
+  return g_callbackNs[cb];
+}
+
+void
+ProfiledCongestionOps::ResetStats (void)
+{
+  for (uint32_t i = 0; i < CB_COUNT; ++i)
+    {
+      g_callbackCalls[i] = 0;
+      g_callbackNs[i] = 0;
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,104 @@
+#ifndef TCP_CDG_PROFILER_H
+#define TCP_CDG_PROFILER_H
+
+#include "ns3/scheduler.h"
+#include "ns3/tcp-congestion-ops.h"
+#include "ns3/type-id.h"
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * Event queue that forwards to another scheduler implementation (the
+ * "Backend" attribute: map, heap, calendar or list) while counting
+ * insertions, removals and the peak number of pending events, and timing
+ * the queue operations. The simulator owns its scheduler privately, so the
+ * counters are process-wide; ResetStats () before a run and read them with
+ * GetStats () before Simulator::Destroy (), which drains the queue.
+ */
+class ProfilingScheduler : public Scheduler
+{
+public:
+  struct Stats
+  {
+    uint64_t inserts;       //!< events scheduled
+    uint64_t removed;       //!< events removed before they ran
+    uint64_t pending;       //!< events in the queue now
+    uint64_t peakPending;   //!< largest queue seen
+    uint64_t queueNs;       //!< wall time inside the backend
+  };
+
+  static TypeId GetTypeId (void);
+
+  ProfilingScheduler ();
+  virtual ~ProfilingScheduler ();
+
+  void SetBackend (TypeId tid);
+  TypeId GetBackend (void) const;
+
+  virtual void Insert (const Event &ev);
+  virtual bool IsEmpty (void) const;
+  virtual Event PeekNext (void) const;
+  virtual Event RemoveNext (void);
+  virtual void Remove (const Event &ev);
+
+  static const Stats &GetStats (void);
+  static void ResetStats (void);
+
+private:
+  TypeId m_backendId;
+  Ptr<Scheduler> m_backend;
+};
+
+/**
+ * Congestion control that forwards every callback to another one and adds
+ * the wall time and number of calls of each callback to process-wide
+ * counters. Wrapping a TcpCDG instance isolates the time a run spends in
+ * CDG from the rest of the TCP stack. Create it with CreateObject and hand
+ * it the wrapped algorithm with SetInner () before the socket uses it.
+ * Fork () wraps a fork of the inner algorithm, so accepted sockets are
+ * profiled too.
+ */
+class ProfiledCongestionOps : public TcpCongestionOps
+{
+public:
+  enum Callback
+  {
+    CB_GET_SS_THRESH,
+    CB_INCREASE_WINDOW,
+    CB_PKTS_ACKED,
+    CB_CONGESTION_STATE_SET,
+    CB_CWND_EVENT,
+    CB_COUNT,
+  };
+
+  static TypeId GetTypeId (void);
+
+  ProfiledCongestionOps ();
+  ProfiledCongestionOps (const ProfiledCongestionOps &sock);
+  virtual ~ProfiledCongestionOps ();
+
+  void SetInner (Ptr<TcpCongestionOps> inner);
+  Ptr<TcpCongestionOps> GetInner (void) const;
+
+  virtual std::string GetName () const;
+  virtual uint32_t GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight);
+  virtual void IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked);
+  virtual void PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked, const Time &rtt);
+  virtual void CongestionStateSet (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCongState_t newState);
+  virtual void CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event);
+  virtual Ptr<TcpCongestionOps> Fork ();
+
+  /** Short name of a callback, used as a column name suffix. */
+  static const char *GetCallbackName (Callback cb);
+  static uint64_t GetCalls (Callback cb);
+  static uint64_t GetNanoSeconds (Callback cb);
+  static void ResetStats (void);
+
+private:
+  Ptr<TcpCongestionOps> m_inner;
+};
+
+} // namespace ns3
+
+#endif /* TCP_CDG_PROFILER_H */
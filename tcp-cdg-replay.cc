@@ -0,0 +1,597 @@
+// Replay recorded ACK/RTT traces through TcpCDG, without a topology.
+//
+// Every trace is memory-mapped and streamed, ACK by ACK, into PktsAcked,
+// IncreaseWindow, GetSsThresh and CwndEvent of its own TcpCDG instance,
+// with the socket state kept cwnd-limited the way the bench drives it.
+// The traces are shared out over a pool of threads; each thread touches
+// only the instances and output of the replay it runs.
+//
+//   tcp-cdg-replay --traces=host1.txt,host2.txt --threads=2 --outPrefix=out
+//   tcp-cdg-replay --traces=ref.bin:0,ref.bin:1
+//
+// Two input formats are understood:
+//
+//  - text, one event per line: "time_ns rtt_ns [segments] [event]",
+//    separated by blanks or commas, where event is A (an ACK, the
+//    default), E (an ACK carrying an ECN echo), L (a loss detected at
+//    that time) or R (a restart after idle). Lines starting with '#'
+//    or a letter are skipped.
+//  - a TraceRecorder file of tcp-cdg-dumbell --recordFile, with ":flow"
+//    selecting the flow (0 by default). Its RTT samples are the ACKs and
+//    a drop of the recorded cwnd not caused by a CDG backoff is a loss.
+//
+// With --outPrefix each replay writes <prefix>-<n>.bin in the TraceRecorder
+// format (for tcp-cdg-trace-to-csv): cwnd and ssthresh whenever they
+// change, every CDG state change and every backoff, stamped with the
+// trace time. A summary line per trace is always printed.
+//
+// The replays have no simulator clock, so the HyStart ACK-train detector,
+// which times ACK spacing, is left out; the delay detector works on the
+// RTT samples alone.
+#include <iostream>
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/tcp-cdg.h"
+#include "tcp-cdg-trace-recorder.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+// One event of a trace.
+struct ReplayEvent
+{
+  enum Kind
+  {
+    ACK,
+    ECN_ACK,
+    LOSS,
+    RESTART
+  };
+
+  int64_t timeNs;
+  int64_t rttNs;
+  uint32_t segments;
+  Kind kind;
+};
+
+// Read-only mapping of a whole file. Pages already consumed are handed
+// back with Release, so a long trace never stays resident as a whole.
+class MappedFile
+{
+public:
+  explicit MappedFile (const std::string &fileName)
+    : m_data (0),
+      m_size (0),
+      m_released (0)
+  {
+    int fd = open (fileName.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        return;
+      }
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size > 0)
+      {
+        void *p = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+          {
+            m_data = static_cast<const char *> (p);
+            m_size = st.st_size;
+            madvise (p, m_size, MADV_SEQUENTIAL);
+          }
+      }
+    close (fd);
+  }
+
+  ~MappedFile ()
+  {
+    if (m_data)
+      {
+        munmap (const_cast<char *> (m_data), m_size);
+      }
+  }
+
+  bool IsOpen (void) const
+  {
+    return m_data != 0;
+  }
+
+  const char *Begin (void) const
+  {
+    return m_data;
+  }
+
+  const char *End (void) const
+  {
+    return m_data + m_size;
+  }
+
+  // Drop the pages wholly before 'upTo' from memory, in steps of 64 MiB.
+  void Release (const char *upTo)
+  {
+    static const size_t chunk = size_t (64) << 20;
+    size_t offset = upTo - m_data;
+    if (offset - m_released >= chunk)
+      {
+        size_t end = offset & ~(size_t (sysconf (_SC_PAGESIZE)) - 1);
+        madvise (const_cast<char *> (m_data) + m_released, end - m_released, MADV_DONTNEED);
+        m_released = end;
+      }
+  }
+
+private:
+  const char *m_data;
+  size_t m_size;
+  size_t m_released;
+};
+
+// Pull parser of the text format, bounded by the end of the mapping.
+class TextTrace
+{
+public:
+  TextTrace (MappedFile &file)
+    : m_file (file),
+      m_pos (file.Begin ())
+  {
+  }
+
+  bool Next (ReplayEvent &event)
+  {
+    const char *end = m_file.End ();
+    while (m_pos < end)
+      {
+        const char *line = m_pos;
+        const char *eol = static_cast<const char *> (std::memchr (line, '\n', end - line));
+        m_pos = eol ? eol + 1 : end;
+        if (!eol)
+          {
+            eol = end;
+          }
+        const char *p = Skip (line, eol);
+        if (p == eol || !(*p >= '0' && *p <= '9'))
+          {
+            continue;
+          }
+        event.timeNs = Number (p, eol);
+        p = Skip (p, eol);
+        event.rttNs = Number (p, eol);
+        p = Skip (p, eol);
+        event.segments = 1;
+        if (p < eol && *p >= '0' && *p <= '9')
+          {
+            event.segments = uint32_t (Number (p, eol));
+            p = Skip (p, eol);
+          }
+        event.kind = ReplayEvent::ACK;
+        if (p < eol)
+          {
+            switch (*p)
+              {
+              case 'E': event.kind = ReplayEvent::ECN_ACK; break;
+              case 'L': event.kind = ReplayEvent::LOSS; break;
+              case 'R': event.kind = ReplayEvent::RESTART; break;
+              default: break;
+              }
+          }
+        m_file.Release (m_pos);
+        return true;
+      }
+    return false;
+  }
+
+private:
+  static const char *Skip (const char *p, const char *end)
+  {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r'))
+      {
+        ++p;
+      }
+    return p;
+  }
+
+  static int64_t Number (const char *&p, const char *end)
+  {
+    int64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+      {
+        v = v * 10 + (*p++ - '0');
+      }
+    return v;
+  }
+
+  MappedFile &m_file;
+  const char *m_pos;
+};
+
+// Events of one flow of a TraceRecorder file.
+class RecordedTrace
+{
+public:
+  RecordedTrace (MappedFile &file, uint32_t flow)
+    : m_file (file),
+      m_flow (flow),
+      m_pos (0),
+      m_end (0),
+      m_lastCwnd (0),
+      m_backoffNs (-1)
+  {
+    const TraceFileHeader *header = reinterpret_cast<const TraceFileHeader *> (file.Begin ());
+    size_t size = file.End () - file.Begin ();
+    if (size >= sizeof (TraceFileHeader)
+        && std::memcmp (header->magic, "CDGTRACE", sizeof (header->magic)) == 0
+        && header->version == TRACE_FILE_VERSION
+        && header->recordSize == sizeof (TraceRecord))
+      {
+        m_pos = reinterpret_cast<const TraceRecord *> (file.Begin () + sizeof (TraceFileHeader));
+        m_end = m_pos + (size - sizeof (TraceFileHeader)) / sizeof (TraceRecord);
+      }
+  }
+
+  bool IsValid (void) const
+  {
+    return m_pos != 0;
+  }
+
+  bool Next (ReplayEvent &event)
+  {
+    while (m_pos && m_pos < m_end)
+      {
+        TraceRecord r;
+        std::memcpy (&r, m_pos++, sizeof (r));
+        if (r.flow != m_flow)
+          {
+            continue;
+          }
+        m_file.Release (reinterpret_cast<const char *> (m_pos));
+        if (r.metric == TRACE_CDG_BACKOFF)
+          {
+            m_backoffNs = r.timeNs;
+          }
+        else if (r.metric == TRACE_CWND_BYTES)
+          {
+            bool drop = r.value < m_lastCwnd && m_backoffNs != r.timeNs;
+            m_lastCwnd = r.value;
+            if (drop)
+              {
+                event.timeNs = r.timeNs;
+                event.rttNs = 0;
+                event.segments = 0;
+                event.kind = ReplayEvent::LOSS;
+                return true;
+              }
+          }
+        else if (r.metric == TRACE_RTT_NS)
+          {
+            event.timeNs = r.timeNs;
+            event.rttNs = int64_t (r.value);
+            event.segments = 1;
+            event.kind = ReplayEvent::ACK;
+            return true;
+          }
+      }
+    return false;
+  }
+
+private:
+  MappedFile &m_file;
+  uint32_t m_flow;
+  const TraceRecord *m_pos;
+  const TraceRecord *m_end;
+  double m_lastCwnd;
+  int64_t m_backoffNs;
+};
+
+// One trace and the sender it drives.
+struct Replay
+{
+  std::string fileName;
+  uint32_t flow;
+  Ptr<TcpSocketState> tcb;
+  Ptr<TcpCDG> cdg;
+  TraceRecorder *out;
+  int64_t nowNs;
+  uint32_t recoveryAcks;
+  uint64_t acks;
+  uint64_t losses;
+  uint64_t ecnMarks;
+  uint64_t backoffs;
+  double cwndSum;
+  double seconds;
+  std::string error;
+};
+
+void replay_state (Replay *replay, TcpCDG::cdg_state oldValue, TcpCDG::cdg_state newValue)
+{
+  if (replay->out)
+    {
+      replay->out->Record (replay->nowNs, 0, TRACE_CDG_STATE, newValue);
+    }
+}
+
+void replay_backoff (Replay *replay, int32_t grad, uint32_t cwnd, uint32_t ssThresh)
+{
+  ++replay->backoffs;
+  if (replay->out)
+    {
+      replay->out->Record (replay->nowNs, 0, TRACE_CDG_BACKOFF, grad);
+    }
+}
+
+// A loss or ECN echo: the window drops to the congestion control's
+// ssthresh and the next window of ACKs is spent in recovery.
+void reduce (Replay &replay, bool ecn)
+{
+  TcpSocketState *tcb = PeekPointer (replay.tcb);
+  if (tcb->m_congState != TcpSocketState::CA_OPEN)
+    {
+      return;
+    }
+  if (ecn)
+    {
+      tcb->m_ecnState = TcpSocketState::ECN_ECE_RCVD;
+    }
+  uint32_t ssThresh = replay.cdg->GetSsThresh (replay.tcb, tcb->m_cWnd.Get ());
+  tcb->m_ssThresh = ssThresh;
+  tcb->m_cWnd = std::max (ssThresh, 2 * tcb->m_segmentSize);
+  tcb->m_congState = ecn ? TcpSocketState::CA_CWR : TcpSocketState::CA_RECOVERY;
+  replay.cdg->CongestionStateSet (replay.tcb, tcb->m_congState);
+  if (ecn)
+    {
+      tcb->m_ecnState = TcpSocketState::ECN_IDLE;
+    }
+  replay.recoveryAcks = 0;
+}
+
+void ack (Replay &replay, const ReplayEvent &event)
+{
+  TcpSocketState *tcb = PeekPointer (replay.tcb);
+  uint32_t segments = std::max<uint32_t> (event.segments, 1);
+  tcb->m_lastAckedSeq += segments * tcb->m_segmentSize;
+  tcb->m_nextTxSequence = tcb->m_lastAckedSeq + tcb->m_cWnd.Get ();
+  tcb->m_highTxMark = tcb->m_nextTxSequence;
+  replay.cdg->PktsAcked (replay.tcb, segments, NanoSeconds (event.rttNs));
+  if (tcb->m_congState == TcpSocketState::CA_OPEN)
+    {
+      replay.cdg->IncreaseWindow (replay.tcb, segments);
+    }
+  else if ((replay.recoveryAcks += segments) * tcb->m_segmentSize >= tcb->m_cWnd.Get ())
+    {
+      tcb->m_cWnd = tcb->m_ssThresh.Get ();
+      bool cwr = tcb->m_congState == TcpSocketState::CA_CWR;
+      tcb->m_congState = TcpSocketState::CA_OPEN;
+      replay.cdg->CongestionStateSet (replay.tcb, TcpSocketState::CA_OPEN);
+      if (cwr)
+        {
+          replay.cdg->CwndEvent (replay.tcb, TcpSocketState::CA_EVENT_COMPLETE_CWR);
+        }
+    }
+  ++replay.acks;
+  replay.cwndSum += tcb->m_cWnd.Get ();
+}
+
+template <typename Trace>
+void run (Replay &replay, Trace &trace)
+{
+  TcpSocketState *tcb = PeekPointer (replay.tcb);
+  uint32_t lastCwnd = 0, lastSsThresh = 0;
+  bool ce = false;
+  ReplayEvent event;
+  while (trace.Next (event))
+    {
+      replay.nowNs = event.timeNs;
+      switch (event.kind)
+        {
+        case ReplayEvent::ECN_ACK:
+          if (!ce)
+            {
+              replay.cdg->CwndEvent (replay.tcb, TcpSocketState::CA_EVENT_ECN_IS_CE);
+              ce = true;
+            }
+          ++replay.ecnMarks;
+          reduce (replay, true);
+          ack (replay, event);
+          break;
+        case ReplayEvent::ACK:
+          if (ce)
+            {
+              replay.cdg->CwndEvent (replay.tcb, TcpSocketState::CA_EVENT_ECN_NO_CE);
+              ce = false;
+            }
+          ack (replay, event);
+          break;
+        case ReplayEvent::LOSS:
+          ++replay.losses;
+          reduce (replay, false);
+          break;
+        case ReplayEvent::RESTART:
+          replay.cdg->CwndEvent (replay.tcb, TcpSocketState::CA_EVENT_CWND_RESTART);
+          break;
+        }
+      if (replay.out)
+        {
+          if (tcb->m_cWnd.Get () != lastCwnd)
+            {
+              lastCwnd = tcb->m_cWnd.Get ();
+              replay.out->Record (event.timeNs, 0, TRACE_CWND_BYTES, lastCwnd);
+            }
+          if (tcb->m_ssThresh.Get () != lastSsThresh)
+            {
+              lastSsThresh = tcb->m_ssThresh.Get ();
+              replay.out->Record (event.timeNs, 0, TRACE_SSTHRESH_BYTES, lastSsThresh);
+            }
+        }
+    }
+}
+
+void replayOne (Replay &replay)
+{
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now ();
+  MappedFile file (replay.fileName);
+  if (!file.IsOpen ())
+    {
+      replay.error = "cannot map " + replay.fileName;
+      return;
+    }
+  size_t size = file.End () - file.Begin ();
+  if (size >= 8 && std::memcmp (file.Begin (), "CDGTRACE", 8) == 0)
+    {
+      RecordedTrace trace (file, replay.flow);
+      if (!trace.IsValid ())
+        {
+          replay.error = replay.fileName + " is not a version 1 CDG trace";
+          return;
+        }
+      run (replay, trace);
+    }
+  else
+    {
+      TextTrace trace (file);
+      run (replay, trace);
+    }
+  if (replay.out)
+    {
+      replay.out->Flush ();
+    }
+  replay.seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - begin).count ();
+}
+
+int main (int argc, char *argv[])
+{
+  std::string traces = "";
+  std::string outPrefix = "";
+  uint32_t threads = std::thread::hardware_concurrency ();
+  uint32_t segmentSize = 1448;
+  uint32_t initialCwnd = 10;
+  uint32_t hystartDetect = TcpCDG::HYSTART_DELAY;
+  int64_t streamBase = 1000;
+
+  CommandLine cmd;
+  cmd.AddValue ("traces", "Comma-separated traces; a TraceRecorder file may be followed by :flow", traces);
+  cmd.AddValue ("threads", "Replays run in parallel", threads);
+  cmd.AddValue ("outPrefix", "Write the decisions of replay n to <outPrefix>-<n>.bin", outPrefix);
+  cmd.AddValue ("segmentSize", "Sender segment size, bytes", segmentSize);
+  cmd.AddValue ("initialCwnd", "Initial window, segments", initialCwnd);
+  cmd.AddValue ("hystartDetect", "CDG slow-start exit; only the delay detector (2) can work without a clock", hystartDetect);
+  cmd.AddValue ("streamBase", "First RNG stream of the CDG backoff draws", streamBase);
+  cmd.Parse (argc, argv);
+
+  if (hystartDetect & TcpCDG::HYSTART_ACK_TRAIN)
+    {
+      std::cerr << "The HyStart ACK-train detector needs a clock and is disabled" << std::endl;
+      hystartDetect &= ~uint32_t (TcpCDG::HYSTART_ACK_TRAIN);
+    }
+  Config::SetDefault ("ns3::TcpCDG::HystartDetect", UintegerValue (hystartDetect));
+
+  // Instances and outputs are all created here, on the main thread, so the
+  // workers never touch ns-3 state shared between replays.
+  std::vector<Replay> replays;
+  std::istringstream list (traces);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      Replay replay;
+      replay.flow = 0;
+      replay.fileName = item;
+      size_t colon = item.rfind (':');
+      if (colon != std::string::npos && colon + 1 < item.size ()
+          && item.find_first_not_of ("0123456789", colon + 1) == std::string::npos)
+        {
+          replay.fileName = item.substr (0, colon);
+          replay.flow = std::strtoul (item.c_str () + colon + 1, 0, 10);
+        }
+      replay.tcb = CreateObject<TcpSocketState> ();
+      replay.tcb->m_segmentSize = segmentSize;
+      replay.tcb->m_initialCWnd = initialCwnd;
+      replay.tcb->m_cWnd = initialCwnd * segmentSize;
+      replay.tcb->m_ssThresh = 0xffffffff;
+      replay.tcb->m_lastAckedSeq = SequenceNumber32 (1);
+      replay.tcb->m_nextTxSequence = replay.tcb->m_lastAckedSeq + replay.tcb->m_cWnd.Get ();
+      replay.tcb->m_highTxMark = replay.tcb->m_nextTxSequence;
+      replay.tcb->m_congState = TcpSocketState::CA_OPEN;
+      replay.cdg = CreateObject<TcpCDG> ();
+      replay.cdg->AssignStreams (streamBase + replays.size ());
+      replay.out = 0;
+      if (!outPrefix.empty ())
+        {
+          std::ostringstream name;
+          name << outPrefix << "-" << replays.size () << ".bin";
+          replay.out = new TraceRecorder (name.str ());
+          if (!replay.out->IsOpen ())
+            {
+              NS_FATAL_ERROR ("Cannot open trace file " << name.str ());
+            }
+        }
+      replay.nowNs = 0;
+      replay.recoveryAcks = 0;
+      replay.acks = replay.losses = replay.ecnMarks = replay.backoffs = 0;
+      replay.cwndSum = 0;
+      replay.seconds = 0;
+      replays.push_back (replay);
+    }
+  if (replays.empty ())
+    {
+      NS_FATAL_ERROR ("No traces given, use --traces");
+    }
+  for (uint32_t i = 0; i < replays.size (); ++i)
+    {
+      replays[i].cdg->TraceConnectWithoutContext ("State", MakeBoundCallback (&replay_state, &replays[i]));
+      replays[i].cdg->TraceConnectWithoutContext ("Backoff", MakeBoundCallback (&replay_backoff, &replays[i]));
+    }
+
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now ();
+  std::atomic<uint32_t> next (0);
+  std::vector<std::thread> workers;
+  threads = std::max<uint32_t> (1, std::min<uint32_t> (threads, replays.size ()));
+  for (uint32_t t = 0; t < threads; ++t)
+    {
+      workers.push_back (std::thread ([&replays, &next] ()
+        {
+          uint32_t i;
+          while ((i = next.fetch_add (1)) < replays.size ())
+            {
+              replayOne (replays[i]);
+            }
+        }));
+    }
+  for (uint32_t t = 0; t < workers.size (); ++t)
+    {
+      workers[t].join ();
+    }
+  double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - begin).count ();
+
+  int status = 0;
+  uint64_t totalAcks = 0;
+  for (uint32_t i = 0; i < replays.size (); ++i)
+    {
+      const Replay &r = replays[i];
+      if (!r.error.empty ())
+        {
+          std::cerr << r.error << std::endl;
+          status = 1;
+          continue;
+        }
+      totalAcks += r.acks;
+      std::cout << i << " " << r.fileName << ":" << r.flow << ": " << r.acks << " ACKs, "
+                << r.losses << " losses, " << r.ecnMarks << " ECN echoes, " << r.backoffs << " backoffs, "
+                << "mean cwnd " << (r.acks ? r.cwndSum / r.acks : 0) << ", final cwnd " << r.tcb->m_cWnd.Get ()
+                << " ssthresh " << r.tcb->m_ssThresh.Get () << ", "
+                << std::setprecision (3) << (r.seconds > 0 ? r.acks / r.seconds / 1e6 : 0) << " M ACKs/s"
+                << std::setprecision (6) << std::endl;
+      delete r.out;
+    }
+  std::cout << totalAcks << " ACKs in " << wall << " s on " << threads << " threads, "
+            << (wall > 0 ? totalAcks / wall / 1e6 : 0) << " M ACKs/s" << std::endl;
+  return status;
+}
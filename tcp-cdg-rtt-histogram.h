@@ -0,0 +1,193 @@
+#ifndef TCP_CDG_RTT_HISTOGRAM_H
+#define TCP_CDG_RTT_HISTOGRAM_H
+
+#include <stdint.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+namespace ns3 {
+
+/**
+ * Streaming log-linear histogram for RTT quantiles, in the spirit of an
+ * HDR histogram. Values below 2^subBucketBits are counted exactly; above
+ * that every power-of-two range is split into 2^subBucketBits equal
+ * buckets. A quantile is reported as the midpoint of the bucket holding
+ * the sample of that rank, so it is within GetRelativeError () of the
+ * exact sample quantile. Memory grows only with the magnitude of the
+ * largest value seen, never with the number of samples.
+ */
+class RttHistogram
+{
+public:
+  explicit RttHistogram (uint32_t subBucketBits = 7)
+    : m_subBits (subBucketBits),
+      m_count (0),
+      m_sum (0),
+      m_min (std::numeric_limits<int64_t>::max ()),
+      m_max (0)
+  {
+  }
+
+  /** Record one non-negative sample; negative values are counted as 0. */
+  void Add (int64_t value)
+  {
+    uint64_t v = value > 0 ? uint64_t (value) : 0;
+    uint32_t index = Index (v);
+    if (index >= m_counts.size ())
+      {
+        m_counts.resize (index + 1, 0);
+      }
+    ++m_counts[index];
+    ++m_count;
+    m_sum += v;
+    m_min = std::min (m_min, int64_t (v));
+    m_max = std::max (m_max, int64_t (v));
+  }
+
+  /** Add the samples of another histogram with the same resolution. */
+  void Merge (const RttHistogram &other)
+  {
+    if (other.m_counts.size () > m_counts.size ())
+      {
+        m_counts.resize (other.m_counts.size (), 0);
+      }
+    for (uint32_t i = 0; i < other.m_counts.size (); ++i)
+      {
+        m_counts[i] += other.m_counts[i];
+      }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min (m_min, other.m_min);
+    m_max = std::max (m_max, other.m_max);
+  }
+
+  /**
+   * The whole state as one flat array (bucket counts, then count, sum, min
+   * and max), to move a histogram between processes; FromImage () of it
+   * merges exactly like the original.
+   */
+  std::vector<uint64_t> ToImage (void) const
+  {
+    std::vector<uint64_t> image (m_counts);
+    image.push_back (m_count);
+    image.push_back (m_sum);
+    image.push_back (uint64_t (m_min));
+    image.push_back (uint64_t (m_max));
+    return image;
+  }
+
+  /** Rebuild a histogram from size words of ToImage () output. */
+  static RttHistogram FromImage (const uint64_t *image, uint32_t size, uint32_t subBucketBits = 7)
+  {
+    RttHistogram h (subBucketBits);
+    if (size < 4)
+      {
+        return h;
+      }
+    h.m_counts.assign (image, image + size - 4);
+    h.m_count = image[size - 4];
+    h.m_sum = image[size - 3];
+    h.m_min = int64_t (image[size - 2]);
+    h.m_max = int64_t (image[size - 1]);
+    return h;
+  }
+
+  uint64_t GetCount (void) const
+  {
+    return m_count;
+  }
+
+  int64_t GetMin (void) const
+  {
+    return m_count ? m_min : 0;
+  }
+
+  int64_t GetMax (void) const
+  {
+    return m_max;
+  }
+
+  double GetMean (void) const
+  {
+    return m_count ? double (m_sum) / m_count : 0.0;
+  }
+
+  /**
+   * \param q quantile in [0, 1]
+   * \return estimate of the sample of rank ceil(q * count), or 0 when empty
+   */
+  int64_t GetQuantile (double q) const
+  {
+    if (m_count == 0)
+      {
+        return 0;
+      }
+    uint64_t rank = uint64_t (q * m_count + 0.999999999);
+    rank = std::max<uint64_t> (1, std::min (rank, m_count));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < m_counts.size (); ++i)
+      {
+        seen += m_counts[i];
+        if (seen >= rank)
+          {
+            int64_t mid = int64_t (LowerBound (i) + Width (i) / 2);
+            return std::max (m_min, std::min (m_max, mid));
+          }
+      }
+    return m_max;
+  }
+
+  /** Bound on |estimate - exact| / exact for any quantile. */
+  double GetRelativeError (void) const
+  {
+    return 1.0 / double (uint64_t (2) << m_subBits);
+  }
+
+  /** Bytes held by the bucket counters. */
+  uint64_t GetMemoryBytes (void) const
+  {
+    return m_counts.capacity () * sizeof (uint64_t);
+  }
+
+private:
+  uint32_t Index (uint64_t v) const
+  {
+    uint64_t exact = uint64_t (1) << m_subBits;
+    if (v < exact)
+      {
+        return uint32_t (v);
+      }
+    uint32_t magnitude = 63 - __builtin_clzll (v);
+    uint32_t shift = magnitude - m_subBits;
+    return uint32_t ((shift + 1) * exact + ((v >> shift) - exact));
+  }
+
+  uint64_t LowerBound (uint32_t index) const
+  {
+    uint64_t exact = uint64_t (1) << m_subBits;
+    if (index < exact)
+      {
+        return index;
+      }
+    uint32_t shift = index / exact - 1;
+    return (exact + index % exact) << shift;
+  }
+
+  uint64_t Width (uint32_t index) const
+  {
+    uint64_t exact = uint64_t (1) << m_subBits;
+    return index < exact ? 1 : uint64_t (1) << (index / exact - 1);
+  }
+
+  uint32_t m_subBits;
+  std::vector<uint64_t> m_counts;
+  uint64_t m_count;
+  uint64_t m_sum;
+  int64_t m_min;
+  int64_t m_max;
+};
+
+} // namespace ns3
+
+#endif /* TCP_CDG_RTT_HISTOGRAM_H */
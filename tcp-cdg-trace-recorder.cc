@@ -0,0 +1,125 @@
+#include "tcp-cdg-trace-recorder.h"
+#include <cstring>
+
+namespace ns3 {
+
+const char *
+TraceMetricName (uint32_t metric)
+{
+  static const char *names[TRACE_METRIC_COUNT] = {
+    "queue_packets", "rtt_ns", "cwnd_bytes", "cdg_state", "cdg_backoff",
+    "ssthresh_bytes"
+  };
+  return metric < TRACE_METRIC_COUNT ? names[metric] : "unknown";
+}
+
+bool
+TraceMetricIsEvent (uint32_t metric)
+{
+  return metric == TRACE_CDG_STATE || metric == TRACE_CDG_BACKOFF;
+}
+
+TraceRecorder::TraceRecorder (const std::string &fileName, uint32_t bufferRecords)
+  : m_file (std::fopen (fileName.c_str (), "wb")),
+    m_buffer (bufferRecords ? bufferRecords : 1),
+    m_used (0),
+    m_every (1),
+    m_minIntervalNs (0),
+    m_written (0)
+{
+  if (m_file)
+    {
+      TraceFileHeader header;
+      std::memcpy (header.magic, "CDGTRACE", sizeof (header.magic));
+      header.version = TRACE_FILE_VERSION;
+      header.recordSize = sizeof (TraceRecord);
+      std::fwrite (&header, sizeof (header), 1, m_file);
+    }
+}
+
+TraceRecorder::~TraceRecorder ()
+{
+  Flush ();
+  if (m_file)
+    {
+      std::fclose (m_file);
+    }
+}
+
+void
+TraceRecorder::SetDecimation (uint32_t every)
+{
+  m_every = every ? every : 1;
+}
+
+void
+TraceRecorder::SetMinInterval (int64_t ns)
+{
+  m_minIntervalNs = ns;
+}
+
+TraceRecorder::Series &
+TraceRecorder::GetSeries (uint32_t flow, uint32_t metric)
+{
+  // Link-level series use slot 0, flow n uses slot n + 1.
+  uint64_t slot = (flow == TRACE_NO_FLOW ? 0 : uint64_t (flow) + 1) * TRACE_METRIC_COUNT + metric;
+  if (slot >= m_series.size ())
+    {
+      Series fresh = { 0, INT64_MIN };
+      m_series.resize (slot + 1, fresh);
+    }
+  return m_series[slot];
+}
+
+void
+TraceRecorder::Record (int64_t timeNs, uint32_t flow, uint32_t metric, double value)
+{
+  if (!m_file)
+    {
+      return;
+    }
+  if ((m_every > 1 || m_minIntervalNs > 0) && !TraceMetricIsEvent (metric))
+    {
+      Series &series = GetSeries (flow, metric);
+      if (series.seen++ % m_every != 0
+          || (series.lastNs != INT64_MIN && timeNs - series.lastNs < m_minIntervalNs))
+        {
+          return;
+        }
+      series.lastNs = timeNs;
+    }
+  TraceRecord &r = m_buffer[m_used++];
+  r.timeNs = timeNs;
+  r.flow = flow;
+  r.metric = metric;
+  r.value = value;
+  if (m_used == m_buffer.size ())
+    {
+      Flush ();
+    }
+}
+
+void
+TraceRecorder::Flush (void)
+{
+  if (m_file && m_used)
+    {
+      std::fwrite (&m_buffer[0], sizeof (TraceRecord), m_used, m_file);
+      m_written += m_used;
+    }
+  m_used = 0;
+}
+
+bool
+TraceRecorder::IsOpen (void) const
+{
+  return m_file != 0;
+}
+
+uint64_t
+TraceRecorder::GetRecordsWritten (void) const
+{
+  return m_written + m_used;
+}
+
+} // namespace ns3
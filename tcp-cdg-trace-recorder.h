@@ -0,0 +1,106 @@
+#ifndef TCP_CDG_TRACE_RECORDER_H
+#define TCP_CDG_TRACE_RECORDER_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * Fixed-width binary time-series record. A trace file starts with a
+ * TraceFileHeader followed by these records in host byte order.
+ */
+struct TraceRecord
+{
+  int64_t timeNs;   //!< simulation time of the sample
+  uint32_t flow;    //!< flow index, or TRACE_NO_FLOW for link metrics
+  uint32_t metric;  //!< one of TraceMetric
+  double value;     //!< sample value, in the unit of the metric
+};
+
+struct TraceFileHeader
+{
+  char magic[8];        //!< "CDGTRACE"
+  uint32_t version;     //!< TRACE_FILE_VERSION
+  uint32_t recordSize;  //!< sizeof (TraceRecord)
+};
+
+static const uint32_t TRACE_FILE_VERSION = 1;
+static const uint32_t TRACE_NO_FLOW = 0xffffffff;
+
+enum TraceMetric
+{
+  TRACE_QUEUE_PACKETS = 0,  //!< packets in the bottleneck queue
+  TRACE_RTT_NS,             //!< RTT sample, nanoseconds
+  TRACE_CWND_BYTES,         //!< congestion window, bytes
+  TRACE_CDG_STATE,          //!< TcpCDG::cdg_state
+  TRACE_CDG_BACKOFF,        //!< CDG backoff taken, value is the gradient
+  TRACE_SSTHRESH_BYTES,     //!< slow-start threshold, bytes
+  TRACE_METRIC_COUNT
+};
+
+/** \return the short name of a metric, as written by the CSV converter */
+const char *TraceMetricName (uint32_t metric);
+
+/**
+ * \return true for metrics whose records are discrete events (CDG state
+ * changes and backoffs) rather than samples of a level; dropping one
+ * loses the event, so they are never decimated.
+ */
+bool TraceMetricIsEvent (uint32_t metric);
+
+/**
+ * Buffered writer of TraceRecords. Records are appended to a large
+ * in-memory buffer and written out in blocks, so recording costs no
+ * formatting and no per-event I/O. Each sampled (flow, metric) series can
+ * be decimated by keeping only every n-th sample and/or samples at least a
+ * minimum interval apart; event metrics are always kept in full.
+ */
+class TraceRecorder
+{
+public:
+  /**
+   * \param fileName output file
+   * \param bufferRecords records held in memory between writes
+   */
+  TraceRecorder (const std::string &fileName, uint32_t bufferRecords = 1 << 16);
+  ~TraceRecorder ();
+
+  /** Keep one sample in every \p every of each series (1 keeps all). */
+  void SetDecimation (uint32_t every);
+
+  /** Drop samples closer than \p ns to the last kept one of their series. */
+  void SetMinInterval (int64_t ns);
+
+  void Record (int64_t timeNs, uint32_t flow, uint32_t metric, double value);
+
+  /** Write out the buffered records. */
+  void Flush (void);
+
+  bool IsOpen (void) const;
+
+  uint64_t GetRecordsWritten (void) const;
+
+private:
+  struct Series
+  {
+    uint32_t seen;
+    int64_t lastNs;
+  };
+
+  Series &GetSeries (uint32_t flow, uint32_t metric);
+
+  std::FILE *m_file;
+  std::vector<TraceRecord> m_buffer;
+  uint32_t m_used;
+  uint32_t m_every;
+  int64_t m_minIntervalNs;
+  uint64_t m_written;
+  std::vector<Series> m_series;
+};
+
+} // namespace ns3
+
+#endif /* TCP_CDG_TRACE_RECORDER_H */
@@ -0,0 +1,97 @@
+// Convert a binary trace written by TraceRecorder (tcp-cdg-dumbell
+// --recordFile) to CSV. Usage:
+//
+//   tcp-cdg-trace-to-csv <trace.bin> [out.csv] [metric]
+//
+// Without an output file the CSV goes to stdout; a metric name (see
+// TraceMetricName) keeps only that series.
+
+#include "tcp-cdg-trace-recorder.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+int
+main (int argc, char *argv[])
+{
+  if (argc < 2)
+    {
+      std::fprintf (stderr, "usage: %s <trace.bin> [out.csv] [metric]\n", argv[0]);
+      return 2;
+    }
+  std::FILE *in = std::fopen (argv[1], "rb");
+  if (!in)
+    {
+      std::perror (argv[1]);
+      return 1;
+    }
+  TraceFileHeader header;
+  if (std::fread (&header, sizeof (header), 1, in) != 1
+      || std::memcmp (header.magic, "CDGTRACE", sizeof (header.magic)) != 0
+      || header.version != TRACE_FILE_VERSION
+      || header.recordSize != sizeof (TraceRecord))
+    {
+      std::fprintf (stderr, "%s: not a version %u CDG trace\n", argv[1], TRACE_FILE_VERSION);
+      std::fclose (in);
+      return 1;
+    }
+  std::FILE *out = stdout;
+  if (argc > 2 && std::strcmp (argv[2], "-") != 0)
+    {
+      out = std::fopen (argv[2], "w");
+      if (!out)
+        {
+          std::perror (argv[2]);
+          std::fclose (in);
+          return 1;
+        }
+    }
+  int32_t only = -1;
+  if (argc > 3)
+    {
+      for (uint32_t m = 0; m < TRACE_METRIC_COUNT; ++m)
+        {
+          if (std::strcmp (argv[3], TraceMetricName (m)) == 0)
+            {
+              only = m;
+            }
+        }
+      if (only < 0)
+        {
+          std::fprintf (stderr, "unknown metric %s\n", argv[3]);
+          return 2;
+        }
+    }
+
+  std::fprintf (out, "time_ns,flow,metric,value\n");
+  std::vector<TraceRecord> block (1 << 16);
+  size_t n;
+  while ((n = std::fread (&block[0], sizeof (TraceRecord), block.size (), in)) > 0)
+    {
+      for (size_t i = 0; i < n; ++i)
+        {
+          const TraceRecord &r = block[i];
+          if (only >= 0 && r.metric != uint32_t (only))
+            {
+              continue;
+            }
+          if (r.flow == TRACE_NO_FLOW)
+            {
+              std::fprintf (out, "%lld,,%s,%.17g\n", (long long) r.timeNs, TraceMetricName (r.metric), r.value);
+            }
+          else
+            {
+              std::fprintf (out, "%lld,%u,%s,%.17g\n", (long long) r.timeNs, r.flow, TraceMetricName (r.metric), r.value);
+            }
+        }
+    }
+  std::fclose (in);
+  if (out != stdout)
+    {
+      std::fclose (out);
+    }
+  return 0;
+}
@@ -2,8 +2,24 @@
 #include "ns3/tcp-socket-base.h"
 #include "ns3/tcp-congestion-ops.h"
 #include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include "ns3/enum.h"
+#include "ns3/boolean.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/simulator.h"
+#include "ns3/tcp-option-ts.h"
+#include "ns3/data-rate.h"
 #include <sys/time.h>
 #include <float.h>
+#include <stdlib.h>
+#include <limits>
+#include <new>
+#include <atomic>
+#include <type_traits>
+#include "ns3/rng-stream.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace ns3
 {
@@ -14,49 +30,135 @@ namespace ns3
 	TypeId TcpCDG::GetTypeId (void)
 	{
 		static TypeId tid = TypeId ("ns3::TcpCDG")
-		.SetParent<TcpCongestionOps> () //Doubt
+		.SetParent<TcpCongestionOps> ()
 		.AddConstructor<TcpCDG> ()
 		.SetGroupName ("Internet")
-		.AddAttribute("RTTSequence",
-				"Value of rtt sequence", // Edit
-				UintegerValue(), // Edit
-				MakeUintegerAccessor (&TcpCDG::rtt_seq),
-                   		MakeUintegerChecker<uint32_t> ())
-		.AddAttribute("LossCwnd",
-				"Value of loss congestion window", //Edit
-				UintegerValue(), //Edit
-				MakeUintegerAccessor (&TcpCDG::loss_cwnd),
-                   		MakeUintegerChecker<uint32_t> ())
 		.AddAttribute("BackoffBeta", 
-				"Value of backoff beta", //Edit
-				UintegerValue(), //Edit
+				"Window kept by a delay-based backoff, in 1/1024: ssthresh and cwnd become cwnd * beta / 1024, at least 2 segments (1-1024)",
+				UintegerValue(724),
 				MakeUintegerAccessor (&TcpCDG::backoff_beta),
-                   		MakeUintegerChecker<uint32_t> ())
+                   		MakeUintegerChecker<uint16_t> (1, 1024))
 		.AddAttribute("BackoffFactor", 
-				"Value of backoff factor", //Edit
-				UintegerValue(), //Edit
+				"Backoff probability per microsecond of smoothed RTT gradient: P[backoff] = 1 - exp(-grad * factor / 1e6); 0 never backs off",
+				UintegerValue(42),
 				MakeUintegerAccessor (&TcpCDG::backoff_factor),
                    		MakeUintegerChecker<uint32_t> ())
-		.AddAttribute("BackoffCount",
-				"Value of backoff count", //Edit
-				UintegerValue(), //Edit
-				MakeUintegerAccessor (&TcpCDG::backoff_cnt),
-                   		MakeUintegerChecker<uint32_t> ())
-		.AddAttribute("Delack", 
-				"Value of Delack", //Edit
-				UintegerValue(), //Edit
-				MakeUintegerAccessor (&TcpCDG::delack),
-                   		MakeUintegerChecker<uint32_t> ())
 		.AddAttribute("IneffectiveThresh",
-				"Value of ineffective thresh", 
-				UintegerValue(), //Edit
-				MakeUintegerAccessor (&TcpCDG::ineffective_thresh), //Edit
-				MakeUintegerChecker<uint32_t> ())
+				"Consecutive backoffs that do not turn a smoothed gradient negative before CDG stops backing off on delay; 0 never stops",
+				UintegerValue(5),
+				MakeUintegerAccessor (&TcpCDG::ineffective_thresh),
+				MakeUintegerChecker<uint16_t> ())
 		.AddAttribute("IneffectiveHold",
-				"Value of ineffective hold", 
-				UintegerValue(), //Edit
-				MakeUintegerAccessor (&TcpCDG::ineffective_hold), //Edit
+				"Backoffs skipped once IneffectiveThresh is passed, before delay-based backoff resumes",
+				UintegerValue(5),
+				MakeUintegerAccessor (&TcpCDG::ineffective_hold),
+				MakeUintegerChecker<uint16_t> ())
+		.AddAttribute("Window",
+				"Number of RTT gradients in the moving average (power of two)",
+				UintegerValue(DEFAULT_WINDOW),
+				MakeUintegerAccessor (&TcpCDG::SetWindow, &TcpCDG::GetWindow),
+				MakeUintegerChecker<uint32_t> (1, std::max<uint32_t> (MAX_WINDOW, 1)))
+		.AddAttribute("GradientFilter",
+				"Smoothing of the RTT gradients: moving window, or EWMA with constant state (the only one if built with TCP_CDG_MAX_WINDOW=0)",
+				EnumValue(MAX_WINDOW ? FILTER_WINDOW : FILTER_EWMA),
+				MakeEnumAccessor (&TcpCDG::SetFilter, &TcpCDG::GetFilter),
+				MakeEnumChecker (FILTER_WINDOW, "window",
+						FILTER_EWMA, "ewma"))
+		.AddAttribute("EwmaShift",
+				"EWMA filter weight 2^-shift; 2 ages gradients like a window of 8",
+				UintegerValue(2),
+				MakeUintegerAccessor (&TcpCDG::ewma_shift),
+				MakeUintegerChecker<uint8_t> (1, 8))
+		.AddAttribute("UseShadow",
+				"Keep a shadow window so losses after a delay-based backoff do not reduce cwnd twice",
+				BooleanValue(true),
+				MakeBooleanAccessor (&TcpCDG::use_shadow),
+				MakeBooleanChecker ())
+		.AddAttribute("LossTolerance",
+				"On ECN-capable flows, ignore losses while the gradients show a non-full queue; ECN echoes always reduce. Only safe behind a marking AQM",
+				BooleanValue(false),
+				MakeBooleanAccessor (&TcpCDG::loss_tolerance),
+				MakeBooleanChecker ())
+		.AddAttribute("CwndClamp",
+				"Upper bound on cwnd growth, in segments",
+				UintegerValue(std::numeric_limits<uint32_t>::max ()),
+				MakeUintegerAccessor (&TcpCDG::cwnd_clamp),
+				MakeUintegerChecker<uint32_t> (2))
+		.AddAttribute("ScalableWindow",
+				"Above this cwnd in segments, CA grows by at least 1% per RTT (Scalable TCP); 0 disables",
+				UintegerValue(0),
+				MakeUintegerAccessor (&TcpCDG::scalable_window),
+				MakeUintegerChecker<uint32_t> ())
+		.AddAttribute("HystartDetect",
+				"Slow-start exit detection: 1 ACK train, 2 delay increase, 3 both, 0 off",
+				UintegerValue(HYSTART_ACK_TRAIN | HYSTART_DELAY),
+				MakeUintegerAccessor (&TcpCDG::hystart_detect),
+				MakeUintegerChecker<uint8_t> (0, HYSTART_ACK_TRAIN | HYSTART_DELAY))
+		.AddAttribute("AckAggregation",
+				"ACKs covering more segments than this only lower the RTT minimum (2 suits delayed ACKs with stretch ACKs from offload or ACK thinning); 0 disables. Not in the reference CDG, so off by default",
+				UintegerValue(0),
+				MakeUintegerAccessor (&TcpCDG::ack_aggregation),
 				MakeUintegerChecker<uint32_t> ())
+		.AddAttribute("UseTimestamps",
+				"Take RTT samples from the echoed TCP timestamp when there is one",
+				BooleanValue(false),
+				MakeBooleanAccessor (&TcpCDG::use_timestamps),
+				MakeBooleanChecker ())
+		.AddAttribute("PacingSsRatio",
+				"Pacing rate in slow start, percent of cwnd/srtt (when the socket paces)",
+				UintegerValue(200),
+				MakeUintegerAccessor (&TcpCDG::pacing_ss_ratio),
+				MakeUintegerChecker<uint16_t> (1))
+		.AddAttribute("PacingCaRatio",
+				"Pacing rate in congestion avoidance, percent of cwnd/srtt",
+				UintegerValue(120),
+				MakeUintegerAccessor (&TcpCDG::pacing_ca_ratio),
+				MakeUintegerChecker<uint16_t> (1))
+		.AddAttribute("RttResolution",
+				"Fixed-point unit of the tracked RTT min/max and gradients",
+				EnumValue(Time::US),
+				MakeEnumAccessor (&TcpCDG::m_rttUnit),
+				MakeEnumChecker (Time::MS, "ms",
+						Time::US, "us",
+						Time::NS, "ns"))
+		.AddAttribute("StateBytes",
+				"Bytes of memory held by one TcpCDG instance, including its backoff RNG",
+				TypeId::ATTR_GET,
+				UintegerValue(0),
+				MakeUintegerAccessor (&TcpCDG::GetStateBytes),
+				MakeUintegerChecker<uint32_t> ())
+		.AddTraceSource("Gradient",
+				"Unsmoothed RTT gradients (min, max) of each measurement",
+				MakeTraceSourceAccessor (&TcpCDG::m_gradientTrace),
+				"ns3::TcpCDG::GradientTracedCallback")
+		.AddTraceSource("SmoothedGradient",
+				"Moving-average RTT gradients (min, max) of each measurement",
+				MakeTraceSourceAccessor (&TcpCDG::m_smoothedGradientTrace),
+				"ns3::TcpCDG::GradientTracedCallback")
+		.AddTraceSource("State",
+				"Queue state inferred from the smoothed gradients",
+				MakeTraceSourceAccessor (&TcpCDG::m_stateTrace),
+				"ns3::TcpCDG::StateTracedCallback")
+		.AddTraceSource("BackoffCounter",
+				"Number of consecutive ineffective backoffs",
+				MakeTraceSourceAccessor (&TcpCDG::m_backoffCountTrace),
+				"ns3::TracedValueCallback::Uint32")
+		.AddTraceSource("Backoff",
+				"Delay-gradient backoff taken (gradient, cwnd before it, new ssthresh, which is also the new cwnd)",
+				MakeTraceSourceAccessor (&TcpCDG::m_backoffTrace),
+				"ns3::TcpCDG::BackoffTracedCallback")
+		.AddTraceSource("LossWindow",
+				"Congestion window recorded at the last loss",
+				MakeTraceSourceAccessor (&TcpCDG::m_lossCwndTrace),
+				"ns3::TracedValueCallback::Uint32")
+		.AddTraceSource("ShadowWindow",
+				"Shadow window restored after losses that follow a backoff",
+				MakeTraceSourceAccessor (&TcpCDG::m_shadowTrace),
+				"ns3::TracedValueCallback::Uint32")
+		.AddTraceSource("SlowStartExit",
+				"HyStart ended slow start (HYSTART_ACK_TRAIN or HYSTART_DELAY, cwnd)",
+				MakeTraceSourceAccessor (&TcpCDG::m_slowStartExitTrace),
+				"ns3::TcpCDG::SlowStartExitTracedCallback")
 		;
 				
 		
@@ -64,47 +166,205 @@ namespace ns3
 		
 	}
 	
+	/* Live and peak number of instances, for memory accounting. */
+	static std::atomic<uint64_t> g_liveInstances (0);
+	static std::atomic<uint64_t> g_peakInstances (0);
+
+	static_assert (std::is_trivially_copyable<TcpCDG::FlowState>::value,
+		"TcpCDG::FlowState must stay trivially copyable");
+
 	//Default Constructor
 	//Assign default values to attributes here
 	TcpCDG::TcpCDG (void)
-	:TcpCongestionOps () //Doubt
+	:TcpCongestionOps ()
 	{
 		NS_LOG_FUNCTION (this);
   		NS_LOG_INFO("CDG");
+		std::memset (&m_flow, 0, sizeof (m_flow));
+		m_flow.gradients.Reset (window);
+		m_uv = CreateObject<UniformRandomVariable> ();
+		CountInstance ();
 	}
 	
 	//Parametrized Constructor taking CDG socket
 	//Assign default values to attributes here
 
 	TcpCDG::TcpCDG (const TcpCDG &sock)
-	:TcpCongestionOps (sock), // Doubt
+	:TcpCongestionOps (sock),
+	m_flow (sock.m_flow),
 	window(sock.window),
-	backoff_beta(sock.backoff_beta),
 	backoff_factor(sock.backoff_factor),
+	cwnd_clamp (sock.cwnd_clamp),
+	scalable_window (sock.scalable_window),
+	backoff_beta(sock.backoff_beta),
 	ineffective_thresh(sock.ineffective_thresh),
 	ineffective_hold(sock.ineffective_hold),
-	rtt_seq (sock.rtt_seq),
-	loss_cwnd (sock.loss_cwnd),
-	tail (sock.tail),
-	backoff_cnt (sock.backoff_cnt),
-	ecn_ce (sock.ecn_ce)
+	use_shadow (sock.use_shadow),
+	loss_tolerance (sock.loss_tolerance),
+	hystart_detect (sock.hystart_detect),
+	filter (sock.filter),
+	ewma_shift (sock.ewma_shift),
+	ack_aggregation (sock.ack_aggregation),
+	use_timestamps (sock.use_timestamps),
+	pacing_ss_ratio (sock.pacing_ss_ratio),
+	pacing_ca_ratio (sock.pacing_ca_ratio),
+	m_rttUnit (sock.m_rttUnit),
+	m_stream (sock.m_stream)
 	
 	{
 		NS_LOG_FUNCTION (this);
+		/* A forked flow has its own generator; if the parent's stream was
+		 * pinned, the fork replays that stream from its start, so its
+		 * draws do not depend on how many objects were numbered before. */
+		m_uv = CreateObject<UniformRandomVariable> ();
+		if (m_stream >= 0)
+			m_uv->SetStream (m_stream);
+		CountInstance ();
 	}
 	
 	TcpCDG::~TcpCDG (void)
 	{
 		NS_LOG_FUNCTION (this);
+		g_liveInstances--;
 	}
 
-	uint32_t TcpCDG::nexp_u32(uint32_t ux)
+	void TcpCDG::CountInstance (void)
+	{
+		uint64_t live = ++g_liveInstances;
+		uint64_t peak = g_peakInstances.load ();
+		while (live > peak && !g_peakInstances.compare_exchange_weak (peak, live))
+			;
+	}
+
+	uint64_t TcpCDG::GetLiveInstances (void)
+	{
+		return g_liveInstances.load ();
+	}
+
+	uint64_t TcpCDG::GetPeakInstances (void)
+	{
+		return g_peakInstances.load ();
+	}
+
+	uint32_t TcpCDG::GetInstanceBytes (void)
+	{
+		/* The RNG object holds its MRG32k3a stream state out of line. */
+		return sizeof (TcpCDG) + sizeof (UniformRandomVariable) + sizeof (RngStream);
+	}
+
+	uint32_t TcpCDG::GetStateBytes (void) const
+	{
+		return GetInstanceBytes ();
+	}
+
+	void TcpCDG::SetState (cdg_state s)
+	{
+		cdg_state old = cdg_state (m_flow.state);
+		if (old != s) {
+			m_flow.state = s;
+			m_stateTrace (old, s);
+		}
+	}
+
+	void TcpCDG::SetLossCwnd (uint32_t cwnd)
+	{
+		uint32_t old = m_flow.loss_cwnd;
+		if (old != cwnd) {
+			m_flow.loss_cwnd = cwnd;
+			m_lossCwndTrace (old, cwnd);
+		}
+	}
+
+	void TcpCDG::SetBackoffCount (uint32_t count)
+	{
+		uint32_t old = m_flow.backoff_cnt;
+		if (old != count) {
+			m_flow.backoff_cnt = count;
+			m_backoffCountTrace (old, count);
+		}
+	}
+
+	void TcpCDG::SetShadowWindow (uint32_t wnd)
+	{
+		uint32_t old = m_flow.shadow_wnd;
+		if (old != wnd) {
+			m_flow.shadow_wnd = wnd;
+			m_shadowTrace (old, wnd);
+		}
+	}
+
+	void *TcpCDG::operator new (size_t size)
+	{
+		void *p;
+		if (posix_memalign (&p, alignof (TcpCDG), size) != 0)
+			throw std::bad_alloc ();
+		return p;
+	}
+
+	void TcpCDG::operator delete (void *p)
+	{
+		free (p);
+	}
+
+	void TcpCDG::SetWindow (uint32_t w)
+	{
+		NS_LOG_FUNCTION (this << w);
+		NS_ABORT_MSG_UNLESS (w && !(w & (w - 1)) && w <= std::max<uint32_t> (MAX_WINDOW, 1),
+			"TcpCDG Window must be a power of two no larger than " << MAX_WINDOW);
+		window = w;
+		m_flow.gradients.Reset (window);
+	}
+
+	uint32_t TcpCDG::GetWindow (void) const
 	{
-		static const uint16_t v[] = {
-			/* exp(-x)*65536-1 for x = 0, 0.000256, 0.000512, ... */
+		return window;
+	}
+
+	void TcpCDG::SetFilter (gradient_filter f)
+	{
+		NS_LOG_FUNCTION (this << f);
+		NS_ABORT_MSG_IF (f == FILTER_WINDOW && !MAX_WINDOW,
+			"TcpCDG was built without a gradient ring (TCP_CDG_MAX_WINDOW=0); only the ewma filter is available");
+		filter = f;
+		m_flow.gradients.Reset (window);
+	}
+
+	TcpCDG::gradient_filter TcpCDG::GetFilter (void) const
+	{
+		return filter;
+	}
+
+	int64_t TcpCDG::AssignStreams (int64_t stream)
+	{
+		NS_LOG_FUNCTION (this << stream);
+		m_stream = stream;
+		m_uv->SetStream (stream);
+		return 1;
+	}
+
+	uint32_t TcpCDG::BackoffExponent (int32_t grad) const
+	{
+		/* backoff_factor is defined per microsecond of gradient, as in the
+		 * reference CDG; rescale gradients measured in other units. The
+		 * product is formed in 64 bits and saturates, since nexp_u32()
+		 * returns 0 for any argument of 2^24 or more anyway. */
+		uint64_t x = uint64_t (grad) * backoff_factor;
+		if (m_rttUnit == Time::MS)
+			x *= 1000;
+		else if (m_rttUnit == Time::NS)
+			x /= 1000;
+		return uint32_t (std::min (x, uint64_t (std::numeric_limits<uint32_t>::max ())));
+	}
+
+	static const uint16_t nexp_table[] = {
+		/* exp(-x)*65536-1 for x = 0, 0.000256, 0.000512, ... */
 					65535,65518, 65501, 65468, 65401, 65267, 65001, 64470, 63422,
 					61378, 57484, 50423, 38795, 22965, 8047, 987,14,
 					};
+
+	uint32_t TcpCDG::nexp_u32(uint32_t ux)
+	{
+		const uint16_t *v = nexp_table;
 		uint64_t res;
 		uint32_t msb = ux >> 8;
 		int i;
@@ -123,35 +383,168 @@ namespace ns3
 		return (uint32_t)res;
 	}
 
+#if defined(__x86_64__) || defined(__i386__)
+	/* The SIMD kernels run all 16 table steps on every lane: a clear msb
+	 * bit multiplies by v[0] + 1 = 65536, which (res * 65536) >> 16 leaves
+	 * unchanged, so the result is bit-exact with the early-exit loop. res
+	 * never exceeds 32 bits, so each step is one 32x32->64 multiply, done
+	 * separately for the even and odd 32-bit lanes. */
+	__attribute__ ((target ("sse2")))
+	static void nexp_u32_sse2 (const uint32_t *ux, uint32_t *out, size_t n)
+	{
+		const __m128i one = _mm_set1_epi32 (65536);
+		const __m128i lowbyte = _mm_set1_epi32 (0xff);
+		const __m128i scale = _mm_set1_epi32 (UINT32_MAX / 1000000);
+		const __m128i all = _mm_set1_epi32 (-1);
+		const __m128i zero = _mm_setzero_si128 ();
+		size_t k = 0;
+		for (; n - k >= 4; k += 4) {
+			__m128i x = _mm_loadu_si128 ((const __m128i *) (ux + k));
+			__m128i msb = _mm_srli_epi32 (x, 8);
+			/* SSE2 has no 32-bit multiply low; the byte times the scale
+			 * stays below 2^21, so a 16x16 split is exact. */
+			__m128i b = _mm_and_si128 (x, lowbyte);
+			__m128i lin = _mm_or_si128 (_mm_mullo_epi16 (b, scale),
+				_mm_slli_epi32 (_mm_mulhi_epu16 (b, scale), 16));
+			__m128i res = _mm_sub_epi32 (all, lin);
+			for (int i = 1; i <= 16; i++) {
+				__m128i bit = _mm_set1_epi32 (1 << (i - 1));
+				__m128i set = _mm_cmpeq_epi32 (_mm_and_si128 (msb, bit), bit);
+				__m128i y = _mm_sub_epi32 (one,
+					_mm_and_si128 (set, _mm_set1_epi32 (65535 - nexp_table[i])));
+				__m128i even = _mm_srli_epi64 (_mm_mul_epu32 (res, y), 16);
+				__m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (res, 32), _mm_srli_epi64 (y, 32));
+				res = _mm_or_si128 (even, _mm_slli_epi64 (_mm_srli_epi64 (odd, 16), 32));
+			}
+			/* Cut off when ux >= 2^24: */
+			res = _mm_and_si128 (res, _mm_cmpeq_epi32 (_mm_srli_epi32 (x, 24), zero));
+			_mm_storeu_si128 ((__m128i *) (out + k), res);
+		}
+		for (; k < n; k++)
+			out[k] = TcpCDG::nexp_u32 (ux[k]);
+	}
+
+	__attribute__ ((target ("avx2")))
+	static void nexp_u32_avx2 (const uint32_t *ux, uint32_t *out, size_t n)
+	{
+		const __m256i one = _mm256_set1_epi32 (65536);
+		const __m256i lowbyte = _mm256_set1_epi32 (0xff);
+		const __m256i scale = _mm256_set1_epi32 (UINT32_MAX / 1000000);
+		const __m256i all = _mm256_set1_epi32 (-1);
+		const __m256i zero = _mm256_setzero_si256 ();
+		size_t k = 0;
+		for (; n - k >= 8; k += 8) {
+			__m256i x = _mm256_loadu_si256 ((const __m256i *) (ux + k));
+			__m256i msb = _mm256_srli_epi32 (x, 8);
+			__m256i res = _mm256_sub_epi32 (all,
+				_mm256_mullo_epi32 (_mm256_and_si256 (x, lowbyte), scale));
+			for (int i = 1; i <= 16; i++) {
+				__m256i bit = _mm256_set1_epi32 (1 << (i - 1));
+				__m256i set = _mm256_cmpeq_epi32 (_mm256_and_si256 (msb, bit), bit);
+				__m256i y = _mm256_sub_epi32 (one,
+					_mm256_and_si256 (set, _mm256_set1_epi32 (65535 - nexp_table[i])));
+				__m256i even = _mm256_srli_epi64 (_mm256_mul_epu32 (res, y), 16);
+				__m256i odd = _mm256_mul_epu32 (_mm256_srli_epi64 (res, 32), _mm256_srli_epi64 (y, 32));
+				res = _mm256_or_si256 (even, _mm256_slli_epi64 (_mm256_srli_epi64 (odd, 16), 32));
+			}
+			res = _mm256_and_si256 (res, _mm256_cmpeq_epi32 (_mm256_srli_epi32 (x, 24), zero));
+			_mm256_storeu_si256 ((__m256i *) (out + k), res);
+		}
+		for (; k < n; k++)
+			out[k] = TcpCDG::nexp_u32 (ux[k]);
+	}
+#endif
+
+	bool TcpCDG::NexpKernelSupported (NexpKernel kernel)
+	{
+		switch (kernel) {
+			case NEXP_AUTO:
+			case NEXP_SCALAR:
+				return true;
+#if defined(__x86_64__) || defined(__i386__)
+			case NEXP_SSE2:
+				return __builtin_cpu_supports ("sse2");
+			case NEXP_AVX2:
+				return __builtin_cpu_supports ("avx2");
+#endif
+			default:
+				return false;
+		}
+	}
+
+	void TcpCDG::NexpBatch (const uint32_t *ux, uint32_t *out, size_t n, NexpKernel kernel)
+	{
+		if (kernel == NEXP_AUTO) {
+			static const NexpKernel best = NexpKernelSupported (NEXP_AVX2) ? NEXP_AVX2
+				: NexpKernelSupported (NEXP_SSE2) ? NEXP_SSE2 : NEXP_SCALAR;
+			kernel = best;
+		}
+		NS_ABORT_MSG_UNLESS (NexpKernelSupported (kernel), "nexp_u32 kernel " << kernel << " is not supported by this CPU");
+		switch (kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+			case NEXP_SSE2:
+				nexp_u32_sse2 (ux, out, n);
+				return;
+			case NEXP_AVX2:
+				nexp_u32_avx2 (ux, out, n);
+				return;
+#endif
+			default:
+				for (size_t k = 0; k < n; k++)
+					out[k] = nexp_u32 (ux[k]);
+				return;
+		}
+	}
+
+	void TcpCDG::BackoffThresholds (const int32_t *grad, uint32_t *out, size_t n) const
+	{
+		for (size_t k = 0; k < n; k++)
+			out[k] = grad[k] > 0 ? BackoffExponent (grad[k]) : 0;
+		NexpBatch (out, out, n);
+		/* No backoff on non-positive gradients, whatever the draw: */
+		for (size_t k = 0; k < n; k++)
+			if (grad[k] <= 0)
+				out[k] = UINT32_MAX;
+	}
+
 	int32_t TcpCDG::tcp_cdg_grad (Ptr<TcpSocketState> tcb)
 	{
-		//Write the code here
 		int32_t grad = 0;
 		int32_t gmin;
 		int32_t gmax;
 
-		if(m_rtt_prev.v64)
+		if(m_flow.rtt_prev.v64)
 		{
-			gmin = m_rtt.min - m_rtt_prev.min;
-			gmax = m_rtt.max - m_rtt_prev.max;
+			gmin = m_flow.rtt.min - m_flow.rtt_prev.min;
+			gmax = m_flow.rtt.max - m_flow.rtt_prev.max;
 			int32_t gmin_s;
 			int32_t gmax_s;
 			
-			gsum.min += gmin - gradients[tail].min;
-			gsum.max += gmax - gradients[tail].max;
-			gradients[tail].min = gmin;
-			gradients[tail].max = gmax;
-			tail = (tail + 1) & (window - 1); //update window parameter in add attribute(probably)
+			if (filter == FILTER_EWMA) {
+				/* sum holds the averages scaled by 2^ewma_shift, so
+				 * avg += (g - avg) / 2^shift needs shifts only and the
+				 * ring is never touched. */
+				struct minmax &avg = m_flow.gradients.sum;
+				avg.min += gmin - (avg.min >> ewma_shift);
+				avg.max += gmax - (avg.max >> ewma_shift);
+				gmin_s = avg.min >> ewma_shift;
+				gmax_s = avg.max >> ewma_shift;
+			} else {
+				m_flow.gradients.Push (gmin, gmax);
 
-			/* We keep sums to ignore gradients during CWR;
-			* smoothed gradients otherwise simplify to:
-			* (rtt_latest - rtt_oldest) / window.
-			*/
-			//gmin_s = DIV_ROUND_CLOSEST(gsum.min, window);
-			//gmax_s = DIV_ROUND_CLOSEST(gsum.max, window);
+				/* We keep sums to ignore gradients during CWR;
+				* smoothed gradients otherwise simplify to:
+				* (rtt_latest - rtt_oldest) / window.
+				*/
+				//gmin_s = DIV_ROUND_CLOSEST(gsum.min, window);
+				//gmax_s = DIV_ROUND_CLOSEST(gsum.max, window);
 
-			gmin_s = gsum.min/window;
-			gmax_s = gsum.max/window;
+				gmin_s = m_flow.gradients.sum.min / int32_t (window);
+				gmax_s = m_flow.gradients.sum.max / int32_t (window);
+			}
+
+			m_gradientTrace (gmin, gmax);
+			m_smoothedGradientTrace (gmin_s, gmax_s);
 
 
 			/* Only use smoothed gradients in CA: */
@@ -164,57 +557,54 @@ namespace ns3
 					grad = gmax > 0 ? gmax : gmax_s;
 				}
 			if (gmin_s > 0 && gmax_s <= 0)
-				state = CDG_FULL;
+				SetState (CDG_FULL);
 			else if ((gmin_s > 0 && gmax_s > 0) || gmax_s < 0)
-				state = CDG_NONFULL;
+				SetState (CDG_NONFULL);
 
 			/* Empty queue: */
-			//if (gmin_s >= 0 && gmax_s < 0)
-				//ca->shadow_wnd = 0;
+			if (gmin_s >= 0 && gmax_s < 0)
+				SetShadowWindow (0);
 
 			/* Backoff was effectual: */
 			if (gmin_s < 0 || gmax_s < 0)
-				backoff_cnt = 0;	
+				SetBackoffCount (0);	
 
 		}
 
-		m_rtt_prev = m_rtt;
-		m_rtt.v64 = 0;
-		std::cout << "\ngmin = "<< gmin << std::endl;
-		std::cout << "\ngmax = "<< gmax << std::endl;
+		m_flow.rtt_prev = m_flow.rtt;
+		m_flow.rtt.v64 = 0;
 		return grad;
 
 	}
 
 	int TcpCDG::tcp_cdg_backoff (Ptr<TcpSocketState> tcb, int32_t grad)
 	{
-		//Write the code here
-		//substitute random number generator for prandom_u32() and add backoff factor, ineffective_thresh, ineff_hold as attributes
-		if (grad <= 0 || uint32_t(std::rand()) /*prandom_u32()*/ <= nexp_u32(grad * backoff_factor)) 
+		/* prandom_u32() equivalent: uniform over the full 32-bit range nexp_u32() maps onto */
+		if (grad <= 0 || m_uv->GetInteger (0, std::numeric_limits<uint32_t>::max ()) <= nexp_u32(BackoffExponent (grad)))
 			return 0;
 		
-		backoff_cnt++;
+		SetBackoffCount (m_flow.backoff_cnt + 1);
 
-		if (backoff_cnt > ineffective_thresh && ineffective_thresh) {
-			if (backoff_cnt >= (ineffective_thresh + ineffective_hold))
-				backoff_cnt = 0;
+		if (m_flow.backoff_cnt > ineffective_thresh && ineffective_thresh) {
+			if (m_flow.backoff_cnt >= (ineffective_thresh + ineffective_hold))
+				SetBackoffCount (0);
 			return 0;
 		}
 
-	//Find out tcb's corresponding attributes for below attributes. If not present initialise them in .h and .cc files
-
-		/* reset TLP and prohibit cwnd undo: */
-		//tp->tlp_high_seq = 0;
-		//tp->prior_ssthresh = 0;
-		tcb->m_initialSsThresh = 0;
-		/* set PRR target and enter CWR: */
-		tcb->m_ssThresh.Set(std::max(2U, (tcb->m_cWnd.Get() * backoff_beta) >> 10U));
-		//tp->prr_delivered = 0;
-		//tp->prr_out = 0;
-		tcb->m_initialCWnd = tcb->m_cWnd.Get();
-		tcb->m_highTxMark = tcb->m_nextTxSequence;
-
-		tcb->m_congState = TcpSocketState::CA_CWR;
+		uint32_t cwnd = tcb->m_cWnd.Get ();
+		SetShadowWindow (std::max (m_flow.shadow_wnd, cwnd));
+		/* 64-bit product: cwnd is in bytes and overflows 32 bits times beta
+		 * beyond a few megabytes. */
+		tcb->m_ssThresh = std::max (2 * tcb->m_segmentSize,
+				uint32_t ((uint64_t (cwnd) * backoff_beta) >> 10U));
+		/* The reference enters CWR and lets PRR bring cwnd down over an
+		 * RTT. TcpSocketBase offers congestion ops no way into CWR, so cut
+		 * cwnd here, as TcpVegas does, and finish the reduction at once:
+		 * what CA_EVENT_COMPLETE_CWR would do after it. The epoch was
+		 * restarted by the caller. */
+		tcb->m_cWnd = tcb->m_ssThresh.Get ();
+		SetState (CDG_UNKNOWN);
+		m_backoffTrace (grad, cwnd, tcb->m_ssThresh.Get ());
 		return 1;
 			
 	}
@@ -226,9 +616,15 @@ namespace ns3
 
   		if (segmentsAcked > 0)
     	{
-      		double adder = static_cast<double> (tcb->m_segmentSize * tcb->m_segmentSize) / tcb->m_cWnd.Get ();
-      		adder = std::max (1.0, adder);
-      		tcb->m_cWnd += static_cast<uint32_t> (adder);
+      		/* Reno's byte adder, segSize^2 / cwnd for every segment acked;
+      		 * with ScalableWindow, at least segSize / 100 above it. */
+      		double segment = tcb->m_segmentSize;
+      		double adder = segment * segment / tcb->m_cWnd.Get ();
+      		if (scalable_window && tcb->m_cWnd.Get () > uint64_t (scalable_window) * tcb->m_segmentSize)
+        		adder = std::max (adder, segment / 100);
+      		adder = std::max (1.0, adder * segmentsAcked);
+      		tcb->m_cWnd = uint32_t (std::min<uint64_t> (tcb->m_cWnd.Get () + uint64_t (adder),
+      				std::numeric_limits<uint32_t>::max ()));
       		NS_LOG_INFO ("In CongAvoid, updated to cwnd " << tcb->m_cWnd <<
                    " ssthresh " << tcb->m_ssThresh);
     	}
@@ -241,124 +637,272 @@ namespace ns3
 
   		if (segmentsAcked >= 1)
     	{
-      		tcb->m_cWnd += tcb->m_segmentSize;
+      		/* One segment per segment acked, up to ssthresh; the rest of
+      		 * the ACK is returned for congestion avoidance. */
+      		uint32_t cwnd = tcb->m_cWnd.Get ();
+      		uint64_t limit = std::max (cwnd, tcb->m_ssThresh.Get ());
+      		tcb->m_cWnd = uint32_t (std::min (uint64_t (cwnd) + uint64_t (segmentsAcked) * tcb->m_segmentSize, limit));
       		NS_LOG_INFO ("In SlowStart, updated to cwnd " << tcb->m_cWnd << " ssthresh " << tcb->m_ssThresh);
-      		return segmentsAcked - 1;
+      		return segmentsAcked - (tcb->m_cWnd.Get () - cwnd) / tcb->m_segmentSize;
     	}
 
-  		return 0;
+		return 0;
+	}
+
+
+	void TcpCDG::SlowStartExit (Ptr<TcpSocketState> tcb, hystart_mode reason)
+	{
+		tcb->m_ssThresh = tcb->m_cWnd.Get ();
+		m_slowStartExitTrace (reason, tcb->m_cWnd.Get ());
+	}
+
+	void TcpCDG::tcp_cdg_hystart_update (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
+	{
+		m_flow.delay_min = m_flow.delay_min ? std::min (m_flow.delay_min, m_flow.rtt.min) : m_flow.rtt.min;
+		if (m_flow.delay_min == 0)
+			return;
+
+		if (hystart_detect & HYSTART_ACK_TRAIN) {
+			uint32_t now_us = uint32_t (Simulator::Now ().GetMicroSeconds ());
+
+			if (m_flow.last_ack == 0 || !IsCwndLimited (tcb, segmentsAcked)) {
+				m_flow.last_ack = now_us;
+				m_flow.round_start = now_us;
+			} else if (int32_t (now_us - (m_flow.last_ack + 3000)) < 0) {
+				/* ACKs still arrive as a train: it has spanned half the
+				 * minimum RTT once the pipe is full. */
+				uint32_t delay_min_us = uint32_t (Time::FromInteger (m_flow.delay_min, m_rttUnit).GetMicroSeconds ());
+				uint32_t base_owd = std::max (delay_min_us / 2U, 125U);
+
+				m_flow.last_ack = now_us;
+				if (int32_t (now_us - (m_flow.round_start + base_owd)) > 0) {
+					SlowStartExit (tcb, HYSTART_ACK_TRAIN);
+					return;
+				}
+			}
+		}
+
+		if (hystart_detect & HYSTART_DELAY) {
+			if (m_flow.sample_cnt < 8) {
+				m_flow.sample_cnt++;
+			} else {
+				int32_t floor = int32_t (MicroSeconds (125).ToInteger (m_rttUnit));
+				int32_t thresh = std::max (m_flow.delay_min + m_flow.delay_min / 8, floor);
+
+				if (m_flow.rtt.min > thresh)
+					SlowStartExit (tcb, HYSTART_DELAY);
+			}
+		}
 	}
 
+	uint32_t TcpCDG::GetCwndClampBytes (Ptr<const TcpSocketState> tcb) const
+	{
+		return uint32_t (std::min<uint64_t> (uint64_t (cwnd_clamp) * tcb->m_segmentSize,
+				std::numeric_limits<uint32_t>::max ()));
+	}
+
+	bool TcpCDG::EpochEnded (Ptr<const TcpSocketState> tcb) const
+	{
+		/* after(ack, rtt_seq): SequenceNumber32 compares modulo 2^32. */
+		return SequenceNumber32 (m_flow.rtt_seq) < tcb->m_lastAckedSeq;
+	}
+
+	void TcpCDG::StartEpoch (Ptr<const TcpSocketState> tcb)
+	{
+		m_flow.rtt_seq = tcb->m_nextTxSequence.Get ().GetValue ();
+		m_flow.epoch_started = true;
+	}
+
+	void TcpCDG::UpdatePacingRate (Ptr<TcpSocketState> tcb) const
+	{
+		/* tcp_update_pacing_rate(): cwnd/srtt with headroom to probe,
+		 * more of it while slow start is still well below ssthresh. */
+		if (!tcb->m_pacing || m_flow.srtt <= 0)
+			return;
+		uint32_t ratio = tcb->m_cWnd.Get () < tcb->m_ssThresh.Get () / 2
+				? pacing_ss_ratio : pacing_ca_ratio;
+		double seconds = Time::FromInteger (m_flow.srtt, m_rttUnit).GetSeconds ();
+		double bps = 8.0 * tcb->m_cWnd.Get () * ratio / 100 / seconds;
+		tcb->m_currentPacingRate = DataRate (uint64_t (std::min (bps, double (tcb->m_maxPacingRate.GetBitRate ()))));
+	}
+
+	bool TcpCDG::IsCwndLimited (Ptr<const TcpSocketState> tcb, uint32_t segmentsAcked) const
+	{
+		/* tcp_is_cwnd_limited() equivalent: the data outstanding before
+		 * this ACK is compared with cwnd. In slow start, growth continues
+		 * while at least half of cwnd was in flight. */
+		uint32_t inFlight = uint32_t (tcb->m_highTxMark.Get () - tcb->m_lastAckedSeq)
+			+ segmentsAcked * tcb->m_segmentSize;
+		if (tcb->m_cWnd.Get () <= tcb->m_ssThresh.Get ())
+			return tcb->m_cWnd.Get () < 2 * inFlight;
+		return inFlight + tcb->m_segmentSize > tcb->m_cWnd.Get ();
+	}
 
 	void TcpCDG::IncreaseWindow (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked)
 	{
-		//Write the code here
-		if (!gradients) // Get the meaning of this function
-			return CongestionAvoidance (tcb, segmentsAcked);			
-			//return tcp_reno_cong_avoid(sk, ack, acked); // Find the corresponding function
-		/* Measure filtered gradients once per RTT: */
+		if (tcb->m_cWnd.Get() < tcb->m_ssThresh.Get() && hystart_detect)
+			tcp_cdg_hystart_update (tcb, segmentsAcked);
 
-		if (segmentsAcked-rtt_seq < 0/*after(segmentsAcked, rtt_seq)*/ && m_rtt.v64) {
+		/* Measure filtered gradients once per RTT: an epoch ends when
+		 * the data outstanding at its start has been acknowledged. */
+		if (!m_flow.epoch_started)
+			StartEpoch (tcb);
+
+		if (EpochEnded (tcb) && m_flow.rtt.v64) {
 			int32_t grad = tcp_cdg_grad(tcb);
-			rtt_seq = tcb->m_nextTxSequence.Get().GetValue();
+			StartEpoch (tcb);
+			m_flow.last_ack = 0;
+			m_flow.sample_cnt = 0;
 
-			if (tcp_cdg_backoff(tcb, grad))
+			if (tcp_cdg_backoff(tcb, grad)) {
+				UpdatePacingRate (tcb);
 				return;
+			}
+		}
 
-		} else if (tcb->m_cWnd.Get() > tcb->m_ssThresh.Get()) {
-			/* In CA, synchronize cwnd growth with delay gradients. */
+		if (!IsCwndLimited (tcb, segmentsAcked)) {
+			SetShadowWindow (std::min (m_flow.shadow_wnd, tcb->m_cWnd.Get ()));
 			return;
 		}
 
-		//if (!tcp_is_cwnd_limited(sk)) { 
-		//	ca->shadow_wnd = min(ca->shadow_wnd, tp->snd_cwnd);
-		//	return;
-		//}
-
+		/* tcp_reno_cong_avoid(): slow start up to ssthresh, the rest of
+		 * the ACK in congestion avoidance, growth held at the clamp. */
+		uint32_t clamp = GetCwndClampBytes (tcb);
+		uint32_t prior_cwnd = tcb->m_cWnd.Get ();
+		if (prior_cwnd >= clamp)
+			return;
 		if (tcb->m_cWnd.Get() <= tcb->m_ssThresh.Get())
-			SlowStart(tcb, segmentsAcked);			
-			//tcp_slow_start(tp, acked); //Find Equivalent function
+			segmentsAcked = SlowStart(tcb, segmentsAcked);
+		if (segmentsAcked && tcb->m_cWnd.Get() >= tcb->m_ssThresh.Get())
+			CongestionAvoidance (tcb, segmentsAcked);
+		tcb->m_cWnd = std::min (tcb->m_cWnd.Get (), clamp);
 
-		else if (tcb->m_cWnd.Get() <  65535/*tp->snd_cwnd_clamp*/) //Find equivalent variable of snd_cwnd_clamp
-			tcb->m_cWnd++;
+		/* The shadow window grows by whatever cwnd gained on this ACK, so
+		 * it keeps its lead from the last backoff but no more: a loss
+		 * then still halves it below cwnd. */
+		uint32_t incr = tcb->m_cWnd.Get () - prior_cwnd;
+		SetShadowWindow (std::min (std::max (m_flow.shadow_wnd, m_flow.shadow_wnd + incr), clamp));
 
-		//if (ca->shadow_wnd && ca->shadow_wnd < tp->snd_cwnd_clamp)
-			//ca->shadow_wnd = max(tp->snd_cwnd, ca->shadow_wnd + 1);
+		UpdatePacingRate (tcb);
 
 		
 	}
 
 	void TcpCDG::PktsAcked (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked,const Time& rtt)
 	{
-		//Write the code here
+		/* RTTs are tracked as fixed-point integers in m_rttUnit, so that
+		 * sub-millisecond samples are not rounded away on short paths. */
+		Time measured = rtt;
+		if (use_timestamps && tcb->m_rcvTimestampEchoReply)
+			/* Per-segment and unaffected by Karn's rule, but only as
+			 * fine as the timestamp clock (1 ms in ns-3). */
+			measured = TcpOptionTS::ElapsedTimeFromTsValue (tcb->m_rcvTimestampEchoReply);
+		int64_t sample = measured.ToInteger (m_rttUnit);
+
+		if(sample <=0)
+		{
+			return;
+		}
+		int32_t rtt_fp = int32_t (std::min (sample, int64_t (std::numeric_limits<int32_t>::max ())));
+
+		/* RFC 6298 smoothing (gain 1/8) of every sample, for pacing. The
+		 * socket may have cut cwnd since the last ACK, so pace now. */
+		m_flow.srtt = m_flow.srtt ? m_flow.srtt + (rtt_fp - m_flow.srtt) / 8 : rtt_fp;
+		UpdatePacingRate (tcb);
 
-		if(rtt.GetMilliSeconds() <=0)
+		if (ack_aggregation && segmentsAcked > ack_aggregation)
 		{
+			/* A stretch ACK (ACK compression, receive offload, or a
+			 * cumulative ACK after recovery) was held back while the
+			 * segments it covers arrived, so its sample is inflated:
+			 * like a delayed ACK, it may only lower the minimum. */
+			if (m_flow.rtt.min)
+				m_flow.rtt.min = std::min (m_flow.rtt.min, rtt_fp);
+			if (m_flow.delack < 5)
+				m_flow.delack++;
 			return;
 		}
-		if (segmentsAcked == 1 && delack)
+
+		if (segmentsAcked == 1 && m_flow.delack)
 		{
-			m_rtt.min = std::min (int64_t(m_rtt.min), rtt.GetMilliSeconds());
-			delack--;
+			/* A delayed ACK is only used for the minimum if it is
+			 * provenly lower than an existing non-zero minimum. */
+			m_flow.rtt.min = std::min (m_flow.rtt.min, rtt_fp);
+			m_flow.delack--;
 			return;
-		}else if(segmentsAcked > 1 && delack < 5) {
-			delack++;
+		}else if(segmentsAcked > 1 && m_flow.delack < 5) {
+			m_flow.delack++;
 		}
 
-		m_rtt.min = std::min(int64_t(m_rtt.min), rtt.GetMilliSeconds()); //Update this line
-		m_rtt.max = std::max(int64_t(m_rtt.max), rtt.GetMilliSeconds());
+		m_flow.rtt.min = m_flow.rtt.min ? std::min (m_flow.rtt.min, rtt_fp) : rtt_fp;
+		m_flow.rtt.max = std::max(m_flow.rtt.max, rtt_fp);
 	}
 
 	uint32_t TcpCDG::GetSsThresh (Ptr<const TcpSocketState> tcb, uint32_t bytesInFlight)
 	{
-		//Write the code here
 		//if (!gradients) //Get the meaning of the function
 		
 			//return tnr.GetSsThresh(tcb, bytesInFlight);			
 			//return tcp_reno_ssthresh(sk);//Do the same as above
 
-		loss_cwnd = tcb->m_cWnd.Get();
-		if (state == CDG_NONFULL && ecn_ce)
+		SetLossCwnd (tcb->m_cWnd.Get());
+		/* An ECN echo is a congestion signal from a queue that is (about
+		 * to be) full, whatever the gradients said: always reduce, and
+		 * stop trusting the NONFULL inference until it is measured again. */
+		bool ecnEcho = tcb->m_ecnState == TcpSocketState::ECN_ECE_RCVD || m_flow.ecn_ce;
+		if (ecnEcho) {
+			SetState (CDG_UNKNOWN);
+		} else if (loss_tolerance && m_flow.state == CDG_NONFULL
+				&& tcb->m_ecnState != TcpSocketState::ECN_DISABLED) {
+			/* Loss tolerance: an ECN-capable bottleneck marks rather than
+			 * drops while its queue is filling, so a loss with a
+			 * non-full queue is taken as non-congestive. */
 			return tcb->m_cWnd.Get();
-		//shadow_wnd >>= 1;
-		//if (!use_shadow)
-			//return max(2U, tp->snd_cwnd >> 1);
-		return std::max(2U,tcb->m_cWnd.Get() >> 1);
+		}
+		/* Halve the shadow window too, but never let it exceed cwnd. */
+		SetShadowWindow (std::min (m_flow.shadow_wnd >> 1, tcb->m_cWnd.Get ()));
+		if (!use_shadow)
+			return std::max(2 * tcb->m_segmentSize, tcb->m_cWnd.Get() >> 1);
+		/* A loss after a delay-based backoff should not halve a window
+		 * that was already reduced: fall back to the shadow window. */
+		return std::max (std::max (2 * tcb->m_segmentSize, m_flow.shadow_wnd), tcb->m_cWnd.Get () >> 1);
 		
 	}
 
 	void TcpCDG::CwndEvent (Ptr<TcpSocketState> tcb, const TcpSocketState::TcpCAEvent_t event)
 	{
-		//Write the code here
 		switch (event) {
 			case TcpSocketState::CA_EVENT_ECN_NO_CE:
-				ecn_ce = false;
+				m_flow.ecn_ce = false;
 				break;
 			case TcpSocketState::CA_EVENT_ECN_IS_CE:
-				ecn_ce = true;
-				state = CDG_UNKNOWN;
+				m_flow.ecn_ce = true;
+				SetState (CDG_UNKNOWN);
 				break;
 			case TcpSocketState::CA_EVENT_CWND_RESTART:
-				if (gradients)
-					memset(gradients, 0, window * sizeof(gradients[0]));
-				memset(&m_rtt, 0, sizeof(struct minmax));
-				memset(&m_rtt_prev, 0, sizeof(struct minmax));
-				memset(&gsum, 0, sizeof(struct minmax));
-				memset(&rtt_seq, 0, sizeof(uint32_t));
-				memset(&loss_cwnd, 0, sizeof(uint32_t));
-				memset(&tail, 0, sizeof(unsigned int));
-				memset(&backoff_cnt, 0 , sizeof(unsigned int));
-				memset(&delack, 0, sizeof(unsigned int));
-				memset(&ecn_ce, 0, sizeof(bool));
-				//memset(ca, 0, sizeof(*ca)); //Change this
-				rtt_seq = tcb->m_nextTxSequence.Get().GetValue(); //Look for correct datatypes
-				//shadow_wnd = tcb.m_cWnd;
+				/* As the reference: all of the flow state starts over
+				 * except the shadow window, which restarts at cwnd. */
+				m_flow.gradients.Reset (window);
+				m_flow.rtt.v64 = 0;
+				m_flow.rtt_prev.v64 = 0;
+				SetLossCwnd (0);
+				SetBackoffCount (0);
+				m_flow.delack = 0;
+				m_flow.ecn_ce = false;
+				m_flow.delay_min = 0;
+				m_flow.last_ack = 0;
+				m_flow.round_start = 0;
+				m_flow.sample_cnt = 0;
+				m_flow.srtt = 0;
+				SetState (CDG_UNKNOWN);
+				StartEpoch (tcb);
+				SetShadowWindow (tcb->m_cWnd.Get ());
 				break;
 			case TcpSocketState::CA_EVENT_COMPLETE_CWR:
-				state = CDG_UNKNOWN;
-				rtt_seq = tcb->m_nextTxSequence.Get().GetValue();
-				m_rtt_prev = m_rtt;
-				m_rtt.v64 = 0;
+				SetState (CDG_UNKNOWN);
+				StartEpoch (tcb);
+				m_flow.rtt_prev = m_flow.rtt;
+				m_flow.rtt.v64 = 0;
 				break;
 			default:
 				break;
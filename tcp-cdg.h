@@ -1,8 +1,29 @@
 #ifndef TCPCDG_H
 #define TCPCDG_H
 #include "ns3/tcp-congestion-ops.h"
+#include "ns3/traced-callback.h"
+#include "ns3/random-variable-stream.h"
+#include <cstring>
+#include <limits>
 // Functions to be implemented by default
 
+/* Build notes: written against ns-3.30. TcpCDG reads m_lastAckedSeq,
+ * m_ecnState and the pacing fields of TcpSocketState, which older releases
+ * lack, and the harnesses size queues with the QueueSize "MaxSize"
+ * attributes that replaced "MaxPackets" (removed in ns-3.29).
+ */
+
+/* Capacity of the inline gradient history. The "Window" attribute may be any
+ * power of two up to this value; rebuild with a larger value to allow longer
+ * moving averages (the reference CDG accepts windows of up to 256). Every
+ * flow carries the whole ring, so the default matches the default window
+ * and a FlowState is two cache lines. 0 leaves the ring out altogether:
+ * only the EWMA gradient filter is available and a FlowState is one line.
+ */
+#ifndef TCP_CDG_MAX_WINDOW
+#define TCP_CDG_MAX_WINDOW 8
+#endif
+
 namespace ns3{
 
 class TcpCDG : public TcpCongestionOps
@@ -27,10 +48,48 @@ class TcpCDG : public TcpCongestionOps
 
 		int tcp_cdg_backoff (Ptr<TcpSocketState> tcb, int32_t grad);
 
-		uint32_t nexp_u32(uint32_t ux);
+		static uint32_t nexp_u32(uint32_t ux);
+
+		/* Implementations of NexpBatch(); NEXP_AUTO picks the widest one
+		 * the CPU supports at run time. */
+		enum NexpKernel {
+			NEXP_AUTO,
+			NEXP_SCALAR,
+			NEXP_SSE2,
+			NEXP_AVX2,
+			};
+
+		static bool NexpKernelSupported (NexpKernel kernel);
+
+		/* out[i] = nexp_u32(ux[i]) for n values, bit-exact with the scalar
+		 * table for every kernel. out may alias ux. */
+		static void NexpBatch (const uint32_t *ux, uint32_t *out, size_t n,
+				NexpKernel kernel = NEXP_AUTO);
+
+		/* Backoff thresholds of n gradients under this flow's settings: a
+		 * backoff is taken when a uniform 32-bit draw exceeds out[i]. */
+		void BackoffThresholds (const int32_t *grad, uint32_t *out, size_t n) const;
+
+		uint32_t BackoffExponent (int32_t grad) const;
+
+		bool IsCwndLimited (Ptr<const TcpSocketState> tcb, uint32_t segmentsAcked) const;
 
 		int32_t tcp_cdg_grad (Ptr<TcpSocketState> tcb);
 
+		void tcp_cdg_hystart_update (Ptr<TcpSocketState> tcb, uint32_t segmentsAcked);
+
+		void SetWindow (uint32_t window);
+
+		uint32_t GetWindow (void) const;
+
+		/**
+		 * Assign a fixed random variable stream number to the backoff
+		 * generator of this flow. Return the number of streams used (1).
+		 * Fork () passes the assignment on: a fork draws from the start
+		 * of the same stream.
+		 */
+		int64_t AssignStreams (int64_t stream);
+
 		static TypeId GetTypeId (void);
 
 		TcpCDG (void);
@@ -39,6 +98,11 @@ class TcpCDG : public TcpCongestionOps
 
 		virtual ~TcpCDG (void);
 
+		/* The per-flow state is cache-line aligned; allocate accordingly. */
+		static void *operator new (size_t size);
+
+		static void operator delete (void *p);
+
 
 	struct minmax {
 			union {
@@ -49,33 +113,181 @@ class TcpCDG : public TcpCongestionOps
 					uint64_t v64;
 				};
 			};
+
+	/* Fixed-capacity ring of (min, max) RTT gradients with running sums.
+	 * Capacity must be a power of two; the active length (window) is any
+	 * power of two not larger than it, so the tail wraps with a mask and
+	 * the moving sums are updated in O(1) per sample. The sums come first
+	 * so they share a cache line with the newest gradients of short
+	 * windows. Storage lives inside the owning object and is copied by
+	 * value.
+	 */
+	template <uint32_t Capacity, bool Ring = (Capacity != 0)>
+	struct GradientWindow {
+			static_assert (Capacity && !(Capacity & (Capacity - 1)),
+				"GradientWindow capacity must be a power of two");
+
+			struct minmax sum;
+			uint32_t tail;
+			uint32_t mask;
+			struct minmax grad[Capacity];
+
+			void Reset (uint32_t window)
+			{
+				std::memset (grad, 0, sizeof (grad));
+				sum.v64 = 0;
+				tail = 0;
+				mask = window - 1;
+			}
+
+			/* Replace the oldest gradient and update the running sums. */
+			void Push (int32_t gmin, int32_t gmax)
+			{
+				sum.min += gmin - grad[tail].min;
+				sum.max += gmax - grad[tail].max;
+				grad[tail].min = gmin;
+				grad[tail].max = gmax;
+				tail = (tail + 1) & mask;
+			}
+			};
+
+	/* Capacity 0: the sums alone, as state of the EWMA filter. */
+	template <uint32_t Capacity>
+	struct GradientWindow<Capacity, false> {
+			struct minmax sum;
+
+			void Reset (uint32_t)
+			{
+				sum.v64 = 0;
+			}
+
+			/* Never called: SetFilter () refuses the window filter. */
+			void Push (int32_t, int32_t)
+			{
+			}
+			};
+
+	static const uint32_t MAX_WINDOW = TCP_CDG_MAX_WINDOW;
+
+	static const uint32_t DEFAULT_WINDOW = MAX_WINDOW == 0 ? 1 : MAX_WINDOW < 8 ? MAX_WINDOW : 8;
 			
 	enum cdg_state {
 		CDG_UNKNOWN = 0,
-		CDG_FULL = 0,
 		CDG_NONFULL = 1,
+		CDG_FULL = 2,
+		};
+
+	/* Everything CDG tracks per flow, packed into one cache-aligned,
+	 * trivially copyable block so that Fork() and the copy constructor
+	 * copy it in one go. Trace sources and configuration live outside.
+	 */
+	struct alignas(64) FlowState {
+			struct minmax rtt;
+			struct minmax rtt_prev;
+			uint32_t rtt_seq;	/* end of the measurement epoch */
+			uint32_t loss_cwnd;
+			uint32_t shadow_wnd;
+			int32_t delay_min;	/* HyStart: lowest RTT, in m_rttUnit */
+			uint32_t last_ack;	/* HyStart: us */
+			uint32_t round_start;	/* HyStart: us */
+			int32_t srtt;		/* pacing: smoothed RTT, in m_rttUnit */
+			uint16_t backoff_cnt;
+			uint8_t delack : 3;	/* at most 5 */
+			uint8_t sample_cnt : 4;	/* HyStart: at most 8 */
+			uint8_t ecn_ce : 1;
+			uint8_t state : 2;	/* cdg_state */
+			uint8_t epoch_started : 1;	/* rtt_seq holds a sequence number */
+			GradientWindow<MAX_WINDOW> gradients;
+			};
+
+	/* GradientFilter modes */
+	enum gradient_filter {
+		FILTER_WINDOW,	/* moving average over the last window gradients */
+		FILTER_EWMA,	/* exponentially weighted, constant state */
+		};
+
+	void SetFilter (gradient_filter f);
+
+	gradient_filter GetFilter (void) const;
+
+	/* HystartDetect bits */
+	enum hystart_mode {
+		HYSTART_ACK_TRAIN = 1,
+		HYSTART_DELAY = 2,
 		};
 
+	/* Signatures of the trace sources registered in GetTypeId. */
+	typedef void (* GradientTracedCallback)(int32_t gmin, int32_t gmax);
+	typedef void (* StateTracedCallback)(const cdg_state oldValue, const cdg_state newValue);
+	typedef void (* BackoffTracedCallback)(int32_t grad, uint32_t cwnd, uint32_t ssThresh);
+	typedef void (* SlowStartExitTracedCallback)(uint32_t reason, uint32_t cwnd);
+
+
+	/* Memory accounting, across all TcpCDG instances of the process. */
+	static uint64_t GetLiveInstances (void);
+
+	static uint64_t GetPeakInstances (void);
+
+	/* Bytes held per instance: the object itself and its backoff RNG. */
+	static uint32_t GetInstanceBytes (void);
 
 	private:
 
-	cdg_state state 	{cdg_state::CDG_UNKNOWN};
-	int window		{0444};
-	unsigned int backoff_beta 	{0444};
-	unsigned int backoff_factor	{0444};
-	unsigned int ineffective_thresh	{0644};
-	unsigned int ineffective_hold	{0644};
-	struct minmax m_rtt;
-	struct minmax m_rtt_prev;
-	struct minmax gsum;
-	struct minmax *gradients;
-	uint32_t rtt_seq;
-	uint32_t loss_cwnd;
-	unsigned int tail;
-	unsigned int backoff_cnt;
-	unsigned int delack;
-	bool ecn_ce;
-	TcpNewReno tnr;
+	uint32_t GetStateBytes (void) const;
+
+	/* Setters of the traced per-flow fields; each fires its trace source
+	 * only when the value changes, as a TracedValue would. */
+	void SetState (cdg_state s);
+
+	void SetLossCwnd (uint32_t cwnd);
+
+	void SetBackoffCount (uint32_t count);
+
+	void SetShadowWindow (uint32_t wnd);
+
+	void CountInstance (void);
+
+	void SlowStartExit (Ptr<TcpSocketState> tcb, hystart_mode reason);
+
+	uint32_t GetCwndClampBytes (Ptr<const TcpSocketState> tcb) const;
+
+	bool EpochEnded (Ptr<const TcpSocketState> tcb) const;
+
+	void StartEpoch (Ptr<const TcpSocketState> tcb);
+
+	void UpdatePacingRate (Ptr<TcpSocketState> tcb) const;
+
+	FlowState m_flow;
+
+	uint32_t window		{DEFAULT_WINDOW};
+	uint32_t backoff_factor	{42};
+	uint32_t cwnd_clamp	{std::numeric_limits<uint32_t>::max ()};	/* segments */
+	uint32_t scalable_window	{0};	/* segments, 0 = off */
+	uint16_t backoff_beta 	{724};	/* 0.7071 * 1024 */
+	uint16_t ineffective_thresh	{5};
+	uint16_t ineffective_hold	{5};
+	bool use_shadow	{true};
+	bool loss_tolerance	{false};
+	uint8_t hystart_detect	{HYSTART_ACK_TRAIN | HYSTART_DELAY};
+	gradient_filter filter	{MAX_WINDOW ? FILTER_WINDOW : FILTER_EWMA};
+	uint8_t ewma_shift	{2};
+	uint32_t ack_aggregation	{0};
+	bool use_timestamps	{false};
+	uint16_t pacing_ss_ratio	{200};	/* percent */
+	uint16_t pacing_ca_ratio	{120};	/* percent */
+	Time::Unit m_rttUnit	{Time::US};
+
+	Ptr<UniformRandomVariable> m_uv;
+	int64_t m_stream	{-1};	/* AssignStreams () value, -1 = automatic */
+
+	TracedCallback<int32_t, int32_t> m_gradientTrace;
+	TracedCallback<int32_t, int32_t> m_smoothedGradientTrace;
+	TracedCallback<int32_t, uint32_t, uint32_t> m_backoffTrace;
+	TracedCallback<cdg_state, cdg_state> m_stateTrace;
+	TracedCallback<uint32_t, uint32_t> m_lossCwndTrace;
+	TracedCallback<uint32_t, uint32_t> m_backoffCountTrace;
+	TracedCallback<uint32_t, uint32_t> m_shadowTrace;
+	TracedCallback<uint32_t, uint32_t> m_slowStartExitTrace;
 };
 
 } //namespace ns3